@@ -1,28 +1,74 @@
 #ifndef __MDIO_NETLINK_H__
 #define __MDIO_NETLINK_H__
 
+#include <linux/ioctl.h>
 #include <linux/types.h>
 
 enum {
 	MDIO_GENL_UNSPEC,
 	MDIO_GENL_XFER,
+	MDIO_GENL_RATE,
+	MDIO_GENL_GET_BUSES,
+	MDIO_GENL_NEW_BUS,
+	MDIO_GENL_DEL_BUS,
+	MDIO_GENL_READ_LIST,
+	MDIO_GENL_WRITE_LIST,
 
 	__MDIO_GENL_MAX,
 	MDIO_GENL_MAX = __MDIO_GENL_MAX - 1
 };
 
+#define MDIO_GENL_MCGRP_BUS_NAME "bus"
+
+enum {
+	MDIO_NL_MCGRP_BUS,
+};
+
 enum {
 	MDIO_NLA_UNSPEC,
 	MDIO_NLA_BUS_ID,  /* string */
-	MDIO_NLA_TIMEOUT, /* u32 */
+	MDIO_NLA_TIMEOUT, /* u16, ms */
 	MDIO_NLA_PROG,    /* struct mdio_nl_insn[] */
 	MDIO_NLA_DATA,    /* nest */
 	MDIO_NLA_ERROR,   /* s32 */
+	MDIO_NLA_PAD,
+	MDIO_NLA_RATE,    /* u32, operations/s, 0 = unlimited */
+	MDIO_NLA_BURST,   /* u32, operations */
+	MDIO_NLA_THROTTLED,    /* u64, number of throttled transfers */
+	MDIO_NLA_THROTTLED_NS, /* u64, total time spent throttled */
+	MDIO_NLA_BUS_CAPS,     /* u32, BIT(enum mdio_nl_bus_cap) */
+	MDIO_NLA_BUS_CLOCK,    /* u32, Hz */
+	MDIO_NLA_ISA,          /* u32, BIT(enum mdio_nl_op) */
+	MDIO_NLA_PROG_MAX,     /* u32, instructions */
+	MDIO_NLA_TIMEOUT_MAX,  /* u32, ms */
+	MDIO_NLA_BUS_HANDLE,   /* u32, alternative to MDIO_NLA_BUS_ID */
+	MDIO_NLA_REGS,         /* struct mdio_nl_reg[] */
+	MDIO_NLA_WRITES,       /* struct mdio_nl_write[] */
+	MDIO_NLA_VERIFY,       /* flag */
+	MDIO_NLA_FLAGS,        /* u32, MDIO_NL_F_*, supported ones in bus info */
+	MDIO_NLA_REPORT,       /* struct mdio_nl_report */
+	MDIO_NLA_TIMEOUT_US,   /* u32, alternative to MDIO_NLA_TIMEOUT */
+	MDIO_NLA_STATE,        /* struct mdio_nl_state */
 
 	__MDIO_NLA_MAX,
 	MDIO_NLA_MAX = __MDIO_NLA_MAX - 1
 };
 
+/* Failed reads do not abort the program. Instead, the error is
+ * reported in the upper half of each datum derived from it. */
+#define MDIO_NL_F_NONFATAL	(1 << 0)
+/* Attach a struct mdio_nl_report to the final reply. */
+#define MDIO_NL_F_REPORT	(1 << 1)
+#define MDIO_NL_F_MASK		(MDIO_NL_F_NONFATAL | MDIO_NL_F_REPORT)
+
+#define MDIO_NL_DATA_ERR	(1U << 31)
+#define MDIO_NL_DATA_ERRNO(_d)	(((_d) >> 16) & 0x7fff)
+
+enum mdio_nl_bus_cap {
+	MDIO_NL_BUS_CAP_C22,
+	MDIO_NL_BUS_CAP_C45,
+};
+
 enum mdio_nl_op {
 	MDIO_NL_OP_UNSPEC,
 	MDIO_NL_OP_READ,	/* read  dev(RI), port(RI), dst(R) */
@@ -33,6 +79,13 @@ enum mdio_nl_op {
 	MDIO_NL_OP_JEQ,		/* jeq   a(RI),   b(RI),    jmp(I) */
 	MDIO_NL_OP_JNE,		/* jeq   a(RI),   b(RI),    jmp(I) */
 	MDIO_NL_OP_EMIT,	/* emit  src(RI) */
+	MDIO_NL_OP_LOCK,	/* lock */
+	MDIO_NL_OP_UNLOCK,	/* unlock */
+	MDIO_NL_OP_PAGE,	/* page  dev(RI), preg(RI), page(RI) */
+	MDIO_NL_OP_MMD_READ,	/* mmdr  dev(RI), reg(RI),  dst(R) */
+	MDIO_NL_OP_MMD_WRITE,	/* mmdw  dev(RI), reg(RI),  src(RI) */
+	MDIO_NL_OP_DELAY,	/* delay us(RI) */
+	MDIO_NL_OP_TIMESTAMP,	/* tstamp */
 
 	__MDIO_NL_OP_MAX,
 	MDIO_NL_OP_MAX = __MDIO_NL_OP_MAX - 1
@@ -53,4 +106,72 @@ struct mdio_nl_insn {
 	__u64 arg2:18;
 };
 
+struct mdio_nl_reg {
+	__u16 dev;	/* PHYAD, or mdio_phy_id_c45(PRTAD, DEVAD) */
+	__u16 reg;
+};
+
+/* If mask is non-zero, the bits set in it are preserved, i.e. the
+ * register is set to (read(reg) & mask) | val. Mismatches found by
+ * verification are emitted as (index << 16) | value. */
+struct mdio_nl_write {
+	__u16 dev;	/* PHYAD, or mdio_phy_id_c45(PRTAD, DEVAD) */
+	__u16 reg;
+	__u16 val;
+	__u16 mask;
+};
+
+struct mdio_nl_report {
+	__u32 insns;	/* instructions executed */
+	__u32 reads;	/* MDIO read operations */
+	__u32 writes;	/* MDIO write operations */
+	__u32 frames;	/* MDIO frames, two per native Clause 45 access */
+	__u64 lock_ns;	/* time spent waiting for the bus lock */
+	__u64 eval_ns;	/* total execution time, including lock_ns */
+};
+
+/* Where a program was when it timed out. Passing it back along with
+ * the same program resumes execution from that point. Programs never
+ * stop inside of a LOCK/UNLOCK section. */
+struct mdio_nl_state {
+	__u32 pc;
+	__u32 flags;	/* MDIO_NL_STATE_F_* */
+	__u16 regs[8];
+	__u16 errs[8];	/* see MDIO_NL_F_NONFATAL */
+
+	/* Page last selected by PAGE, reselected on resume */
+	__u16 page_dev;
+	__u16 page_reg;
+	__u16 page;
+	__u16 reserved;
+};
+
+#define MDIO_NL_STATE_F_PAGE	(1 << 0) /* page_* are valid */
+#define MDIO_NL_STATE_F_MASK	MDIO_NL_STATE_F_PAGE
+
+/* Character device transport, /dev/mdio/<bus>. Programs are passed
+ * using MDIO_NL_IOC_XFER, and their output is written to a ring
+ * that is shared with userspace using mmap(2). The ioctl returns
+ * the number of entries written, or an error. */
+struct mdio_nl_ioc_xfer {
+	__u64 prog;		/* struct mdio_nl_insn[] */
+	__u32 prog_len;		/* instructions */
+	__u32 timeout_us;
+	__u32 flags;		/* MDIO_NL_F_NONFATAL */
+	__u32 reserved;
+};
+
+#define MDIO_NL_IOC_XFER	_IOW('M', 0x80, struct mdio_nl_ioc_xfer)
+
+/* Header of the ring, at the start of the mapping. Entries are
+ * produced at head by the kernel, and consumed at tail by
+ * userspace. Both are free running, i.e. an entry's index is
+ * (head & (size - 1)). */
+struct mdio_nl_ring {
+	__u32 head;
+	__u32 tail;
+	__u32 size;	/* entries, power of two */
+	__u32 offset;	/* of the __u32 entries, from the start */
+};
+
 #endif /* __MDIO_NETLINK_H__ */
@@ -72,4 +72,24 @@ static inline struct mii_bus *mdio_find_bus(const char *mdio_name)
 }
 #endif	/* < 5.7.0 */
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,5,0)
+#include <linux/compat.h>
+#include <linux/fs.h>
+
+#ifdef CONFIG_COMPAT
+static inline long compat_ptr_ioctl(struct file *file, unsigned int cmd,
+				    unsigned long arg)
+{
+	if (!file->f_op->unlocked_ioctl)
+		return -ENOIOCTLCMD;
+
+	return file->f_op->unlocked_ioctl(file, cmd,
+					  (unsigned long)compat_ptr(arg));
+}
+#else
+#define compat_ptr_ioctl NULL
+#endif
+
+#endif	/* < 5.5.0 */
+
 #endif /* _COMPAT_H_ */
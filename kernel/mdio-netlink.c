@@ -1,14 +1,113 @@
 // SPDX-License-Identifier: GPL-2.0
 
+#include <linux/completion.h>
+#include <linux/delay.h>
+#include <linux/firmware.h>
+#include <linux/hrtimer.h>
+#include <linux/idr.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
 #include <linux/mdio-netlink.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/netlink.h>
 #include <linux/phy.h>
+#include <linux/property.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/genetlink.h>
 #include <net/netlink.h>
 #include "compat.h"
+#include "mdio-vm.h"
+
+#define MDIO_NL_PROG_MAX     0x1000
+#define MDIO_NL_TIMEOUT_MAX (10 * MSEC_PER_SEC)
+#define MDIO_NL_RING_SIZE    0x1000
+#define MDIO_NL_SHARE_MAX    256
+#define MDIO_NL_FW_RETRY_MS  10
+
+/* Per-bus state, keyed on the bus ID. */
+struct mdio_nl_bus {
+	struct list_head node;
+	struct kref kref;
+	char id[MII_BUS_ID_SIZE];
+
+	/* Assigned when the bus is registered, zero if it was never
+	 * seen by the class interface. mdio is only valid as long as
+	 * the handle is. */
+	u32 handle;
+	struct mii_bus *mdio;
+
+	/* Only one throttled transfer at a time waits for the bucket
+	 * to refill. No ordering, or fairness between sockets, is
+	 * provided among the others. */
+	struct mutex throttle_lock;
+
+	spinlock_t lock;
+	u32 rate;
+	u32 burst;
+	s64 credit_ns;
+	ktime_t stamp;
+
+	u64 throttled;
+	u64 throttled_ns;
+
+	/* Runs the bus' firmware program, if any, see mdio_nl_fw_run() */
+	struct delayed_work fw_work;
+
+	struct mdio_nl_cdev *cdev;
+
+	/* Recent read-only programs, see mdio_nl_share_get() */
+	struct mutex share_lock;
+	struct list_head shares;
+};
+
+/* The outcome of a read-only program, shared with identical
+ * programs that arrive while it is running, or shortly after. */
+struct mdio_nl_share {
+	struct list_head node;
+	struct kref kref;
+	ktime_t start;
+	struct completion done;
+
+	u32 flags;
+	int prog_len;
+	struct mdio_nl_insn *prog;
+
+	/* Valid once done is completed */
+	bool valid;
+	int err;
+	int len;
+	u32 data[MDIO_NL_SHARE_MAX];
+};
+
+static bool mdio_nl_fw;
+module_param_named(firmware, mdio_nl_fw, bool, 0444);
+MODULE_PARM_DESC(firmware,
+		 "Run mdio-netlink/<bus>.bin when a bus is registered");
+
+static unsigned int mdio_nl_coalesce_us;
+module_param_named(coalesce_us, mdio_nl_coalesce_us, uint, 0644);
+MODULE_PARM_DESC(coalesce_us,
+		 "Window in which identical read-only programs share results");
+
+static bool mdio_nl_chardev;
+module_param_named(chardev, mdio_nl_chardev, bool, 0444);
+MODULE_PARM_DESC(chardev, "Create /dev/mdio/<bus> for each bus");
+
+static LIST_HEAD(mdio_nl_buses);
+static DEFINE_IDR(mdio_nl_handles);
+static DEFINE_MUTEX(mdio_nl_buses_lock);
 
 struct mdio_nl_xfer {
 	struct genl_info *info;
@@ -17,14 +116,33 @@ struct mdio_nl_xfer {
 	struct nlattr *data;
 
 	struct mii_bus *mdio;
-	int timeout_ms;
-
-	int prog_len;
-	struct mdio_nl_insn *prog;
+	struct mdio_vm vm;
+
+	/* Output goes here instead of to msg, if set */
+	struct mdio_nl_ring *ring;
+
+	/* Output is also recorded here, if set */
+	struct mdio_nl_share *share;
+
+	/* Execution statistics, see struct mdio_nl_report. The number
+	 * of instructions is kept by the VM. */
+	u32 reads;
+	u32 writes;
+	u32 frames;
+	u64 lock_ns;
+	u64 eval_ns;
+
+	/* Clause 45 address, if any, that the MMD access registers of
+	 * a Clause 22 PHY were last pointed at. */
+	u16 mmd_dev;
+	u16 mmd_reg;
 };
 
 static int mdio_nl_open(struct mdio_nl_xfer *xfer);
 static int mdio_nl_close(struct mdio_nl_xfer *xfer, bool last, int xerr);
+static void mdio_nl_fw_work(struct work_struct *work);
+static void mdio_nl_cdev_add(struct mdio_nl_bus *bus);
+static void mdio_nl_cdev_del(struct mdio_nl_bus *bus);
 
 static int mdio_nl_flush(struct mdio_nl_xfer *xfer)
 {
@@ -37,10 +155,40 @@ static int mdio_nl_flush(struct mdio_nl_xfer *xfer)
 	return mdio_nl_open(xfer);
 }
 
+static int mdio_nl_ring_put(struct mdio_nl_ring *ring, u32 datum)
+{
+	u32 *entries = (void *)ring + PAGE_SIZE;
+	u32 head = READ_ONCE(ring->head);
+
+	/* Pairs with the release of tail by userspace, once it is done
+	 * with the entries. Never trust the size in the shared header. */
+	if (head - smp_load_acquire(&ring->tail) >= MDIO_NL_RING_SIZE)
+		return -ENOBUFS;
+
+	entries[head & (MDIO_NL_RING_SIZE - 1)] = datum;
+	smp_store_release(&ring->head, head + 1);
+	return 0;
+}
+
 static int mdio_nl_emit(struct mdio_nl_xfer *xfer, u32 datum)
 {
 	int err = 0;
 
+	if (xfer->share) {
+		/* Too much to share, let everyone run on their own */
+		if (xfer->share->len < MDIO_NL_SHARE_MAX)
+			xfer->share->data[xfer->share->len] = datum;
+
+		xfer->share->len++;
+	}
+
+	if (xfer->ring)
+		return mdio_nl_ring_put(xfer->ring, datum);
+
+	/* Firmware programs have nowhere to send their output */
+	if (!xfer->msg)
+		return 0;
+
 	if (!nla_put_nohdr(xfer->msg, sizeof(datum), &datum))
 		return 0;
 
@@ -51,212 +199,308 @@ static int mdio_nl_emit(struct mdio_nl_xfer *xfer, u32 datum)
 	return nla_put_nohdr(xfer->msg, sizeof(datum), &datum);
 }
 
-static inline u16 *__arg_r(u32 arg, u16 *regs)
+static void mdio_nl_lock(struct mdio_nl_xfer *xfer)
+{
+	u64 start = ktime_get_ns();
+
+	mutex_lock(&xfer->mdio->mdio_lock);
+	xfer->lock_ns += ktime_get_ns() - start;
+
+	/* Other users of the bus may have used the MMD access
+	 * registers while we were not holding the lock. */
+	xfer->mmd_dev = 0;
+}
+
+/* Point the MMD access registers (22.2.4.3.11) of a Clause 22 PHY at
+ * a Clause 45 register. The data function is set up without post
+ * increment, so repeated accesses to the same register, e.g. a
+ * read/modify/write or a poll loop, can skip this entirely. */
+static int mdio_nl_mmd_addr(struct mdio_nl_xfer *xfer, u16 dev, u16 reg)
+{
+	int prtad = mdio_phy_id_prtad(dev);
+	int devad = mdio_phy_id_devad(dev);
+	int err;
+
+	if (xfer->mmd_dev == dev && xfer->mmd_reg == reg)
+		return 0;
+
+	xfer->mmd_dev = 0;
+
+	xfer->writes++;
+	xfer->frames++;
+	err = __mdiobus_write(xfer->mdio, prtad, MII_MMD_CTRL, devad);
+	if (err)
+		return err;
+
+	xfer->writes++;
+	xfer->frames++;
+	err = __mdiobus_write(xfer->mdio, prtad, MII_MMD_DATA, reg);
+	if (err)
+		return err;
+
+	xfer->writes++;
+	xfer->frames++;
+	err = __mdiobus_write(xfer->mdio, prtad, MII_MMD_CTRL,
+			      devad | MII_MMD_CTRL_NOINCR);
+	if (err)
+		return err;
+
+	xfer->mmd_dev = dev;
+	xfer->mmd_reg = reg;
+	return 0;
+}
+
+static int mdio_nl_mmd_read(struct mdio_nl_xfer *xfer, u16 dev, u16 reg)
+{
+	int err;
+
+	err = mdio_nl_mmd_addr(xfer, dev, reg);
+	if (err)
+		return err;
+
+	xfer->reads++;
+	xfer->frames++;
+	return __mdiobus_read(xfer->mdio, mdio_phy_id_prtad(dev), MII_MMD_DATA);
+}
+
+static int mdio_nl_mmd_write(struct mdio_nl_xfer *xfer, u16 dev, u16 reg,
+			     u16 val)
 {
-	BUG_ON(arg >> 16 != MDIO_NL_ARG_REG);
+	int err;
+
+	err = mdio_nl_mmd_addr(xfer, dev, reg);
+	if (err)
+		return err;
 
-	return &regs[arg & 0x7];
+	xfer->writes++;
+	xfer->frames++;
+	return __mdiobus_write(xfer->mdio, mdio_phy_id_prtad(dev),
+			       MII_MMD_DATA, val);
 }
 
-static inline u16 __arg_i(u32 arg)
+/* Clause 45 accesses on buses that lack native support for them are
+ * transparently done indirectly, via Clause 22. */
+static int mdio_nl_read(struct mdio_nl_xfer *xfer, u16 dev, u16 reg)
 {
-	BUG_ON(arg >> 16 != MDIO_NL_ARG_IMM);
+	int ret;
+
+	if (!mdio_phy_id_is_c45(dev)) {
+		xfer->reads++;
+		xfer->frames++;
+		return __mdiobus_read(xfer->mdio, dev, reg);
+	}
 
-	return arg & 0xffff;
+	ret = __mdiobus_c45_read(xfer->mdio, mdio_phy_id_prtad(dev),
+				 mdio_phy_id_devad(dev), reg);
+	if (ret == -EOPNOTSUPP)
+		return mdio_nl_mmd_read(xfer, dev, reg);
+
+	/* Address and data frames */
+	xfer->reads++;
+	xfer->frames += 2;
+	return ret;
 }
 
-static inline u16 __arg_ri(u32 arg, u16 *regs)
+static int mdio_nl_write(struct mdio_nl_xfer *xfer, u16 dev, u16 reg,
+			 u16 val)
 {
-	switch ((enum mdio_nl_argmode)(arg >> 16)) {
-	case MDIO_NL_ARG_IMM:
-		return arg & 0xffff;
-	case MDIO_NL_ARG_REG:
-		return regs[arg & 7];
-	default:
-		BUG();
+	int ret;
+
+	if (!mdio_phy_id_is_c45(dev)) {
+		if (reg == MII_MMD_CTRL || reg == MII_MMD_DATA)
+			xfer->mmd_dev = 0;
+
+		xfer->writes++;
+		xfer->frames++;
+		return __mdiobus_write(xfer->mdio, dev, reg, val);
 	}
+
+	ret = __mdiobus_c45_write(xfer->mdio, mdio_phy_id_prtad(dev),
+				  mdio_phy_id_devad(dev), reg, val);
+	if (ret == -EOPNOTSUPP)
+		return mdio_nl_mmd_write(xfer, dev, reg, val);
+
+	xfer->writes++;
+	xfer->frames += 2;
+	return ret;
+}
+
+/* Hooks used by mdio_vm_eval() */
+
+#define vm_to_xfer(_vm) container_of(_vm, struct mdio_nl_xfer, vm)
+
+static int mdio_vm_read(struct mdio_vm *vm, u16 dev, u16 reg)
+{
+	return mdio_nl_read(vm_to_xfer(vm), dev, reg);
 }
 
-static int mdio_nl_eval(struct mdio_nl_xfer *xfer)
+static int mdio_vm_write(struct mdio_vm *vm, u16 dev, u16 reg, u16 val)
 {
-	struct mdio_nl_insn *insn;
-	unsigned long timeout;
-	u16 regs[8] = { 0 };
-	unsigned int pc;
-	int ret = 0;
+	return mdio_nl_write(vm_to_xfer(vm), dev, reg, val);
+}
 
-	timeout = jiffies + msecs_to_jiffies(xfer->timeout_ms);
+static int mdio_vm_mmd_read(struct mdio_vm *vm, u16 dev, u16 reg)
+{
+	return mdio_nl_mmd_read(vm_to_xfer(vm), dev, reg);
+}
 
-	mutex_lock(&xfer->mdio->mdio_lock);
+static int mdio_vm_mmd_write(struct mdio_vm *vm, u16 dev, u16 reg, u16 val)
+{
+	return mdio_nl_mmd_write(vm_to_xfer(vm), dev, reg, val);
+}
+
+static int mdio_vm_emit(struct mdio_vm *vm, u32 datum)
+{
+	return mdio_nl_emit(vm_to_xfer(vm), datum);
+}
+
+static int mdio_vm_yield(struct mdio_vm *vm)
+{
+	if (fatal_signal_pending(current))
+		return -EINTR;
+
+	cond_resched();
+	return 0;
+}
+
+static void mdio_vm_lock(struct mdio_vm *vm)
+{
+	mdio_nl_lock(vm_to_xfer(vm));
+}
+
+static void mdio_vm_unlock(struct mdio_vm *vm)
+{
+	mutex_unlock(&vm_to_xfer(vm)->mdio->mdio_lock);
+}
+
+static u64 mdio_vm_now(struct mdio_vm *vm)
+{
+	return ktime_get_ns();
+}
+
+static void mdio_vm_delay(struct mdio_vm *vm, u16 us)
+{
+	if (us < 10)
+		udelay(us);
+	else
+		usleep_range(us, us + us / 4);
+}
+
+/* Fast path for the common case of reading a set of registers,
+ * without the overhead of the VM. All registers are read under a
+ * single acquisition of the bus lock. */
+static int mdio_nl_read_list(struct mdio_nl_xfer *xfer,
+			     const struct mdio_nl_reg *regs, int n)
+{
+	ktime_t deadline;
+	int i, ret = 0;
+	u32 datum;
+
+	deadline = ktime_add_us(ktime_get(), xfer->vm.timeout_us);
 
-	for (insn = xfer->prog, pc = 0;
-	     pc < xfer->prog_len;
-	     insn = &xfer->prog[++pc]) {
-		if (time_after(jiffies, timeout)) {
+	mdio_nl_lock(xfer);
+
+	for (i = 0; i < n; i++) {
+		if (ktime_after(ktime_get(), deadline)) {
 			ret = -ETIMEDOUT;
 			break;
 		}
 
-		switch ((enum mdio_nl_op)insn->op) {
-		case MDIO_NL_OP_READ:
-			if (mdio_phy_id_is_c45(__arg_ri(insn->arg0, regs)))
-				ret = __mdiobus_c45_read(xfer->mdio,
-							 mdio_phy_id_prtad(__arg_ri(insn->arg0, regs)),
-							 mdio_phy_id_devad(__arg_ri(insn->arg0, regs)),
-							 __arg_ri(insn->arg1, regs));
-			else
-				ret = __mdiobus_read(xfer->mdio,
-				                     __arg_ri(insn->arg0, regs),
-				                     __arg_ri(insn->arg1, regs));
-			if (ret < 0)
-				goto exit;
-			*__arg_r(insn->arg2, regs) = ret;
-			ret = 0;
+		ret = mdio_nl_read(xfer, regs[i].dev, regs[i].reg);
+		if (ret >= 0)
+			datum = ret;
+		else if (xfer->vm.flags & MDIO_NL_F_NONFATAL)
+			datum = mdio_vm_datum(0xffff, -ret);
+		else
 			break;
 
-		case MDIO_NL_OP_WRITE:
-			if (mdio_phy_id_is_c45(__arg_ri(insn->arg0, regs)))
-				ret = __mdiobus_c45_write(xfer->mdio,
-							 mdio_phy_id_prtad(__arg_ri(insn->arg0, regs)),
-							 mdio_phy_id_devad(__arg_ri(insn->arg0, regs)),
-							 __arg_ri(insn->arg1, regs),
-							 __arg_ri(insn->arg2, regs));
-			else
-				ret = __mdiobus_write(xfer->mdio,
-				                      __arg_ri(insn->arg0, regs),
-				                      __arg_ri(insn->arg1, regs),
-						      __arg_ri(insn->arg2, regs));
-			if (ret < 0)
-				goto exit;
-			ret = 0;
+		ret = mdio_nl_emit(xfer, datum);
+		if (ret < 0)
 			break;
+	}
 
-		case MDIO_NL_OP_AND:
-			*__arg_r(insn->arg2, regs) =
-				__arg_ri(insn->arg0, regs) &
-				__arg_ri(insn->arg1, regs);
-			break;
+	mutex_unlock(&xfer->mdio->mdio_lock);
+	return ret;
+}
 
-		case MDIO_NL_OP_OR:
-			*__arg_r(insn->arg2, regs) =
-				__arg_ri(insn->arg0, regs) |
-				__arg_ri(insn->arg1, regs);
-			break;
+static int mdio_nl_write_one(struct mdio_nl_xfer *xfer,
+			     const struct mdio_nl_write *w, int i, bool verify)
+{
+	u16 val = w->val;
+	int ret;
 
-		case MDIO_NL_OP_ADD:
-			*__arg_r(insn->arg2, regs) =
-				__arg_ri(insn->arg0, regs) +
-				__arg_ri(insn->arg1, regs);
-			break;
+	if (w->mask) {
+		ret = mdio_nl_read(xfer, w->dev, w->reg);
+		if (ret < 0)
+			return ret;
 
-		case MDIO_NL_OP_JEQ:
-			if (__arg_ri(insn->arg0, regs) ==
-			    __arg_ri(insn->arg1, regs))
-				pc += (s16)__arg_i(insn->arg2);
-			break;
+		val |= ret & w->mask;
+	}
 
-		case MDIO_NL_OP_JNE:
-			if (__arg_ri(insn->arg0, regs) !=
-			    __arg_ri(insn->arg1, regs))
-				pc += (s16)__arg_i(insn->arg2);
-			break;
+	ret = mdio_nl_write(xfer, w->dev, w->reg, val);
+	if (ret < 0 || !verify)
+		return ret;
 
-		case MDIO_NL_OP_EMIT:
-			ret = mdio_nl_emit(xfer, __arg_ri(insn->arg0, regs));
-			if (ret < 0)
-				goto exit;
-			ret = 0;
-			break;
+	ret = mdio_nl_read(xfer, w->dev, w->reg);
+	if (ret < 0)
+		return ret;
 
-		case MDIO_NL_OP_UNSPEC:
-		default:
-			ret = -EINVAL;
-			goto exit;
+	if (ret == val)
+		return 0;
+
+	return mdio_nl_emit(xfer, (i << 16) | ret);
+}
+
+/* Counterpart of mdio_nl_read_list(), for applying tables of
+ * register settings, e.g. PHY errata, in one atomic operation. */
+static int mdio_nl_write_list(struct mdio_nl_xfer *xfer,
+			      const struct mdio_nl_write *writes, int n,
+			      bool verify)
+{
+	ktime_t deadline;
+	int i, ret = 0;
+
+	deadline = ktime_add_us(ktime_get(), xfer->vm.timeout_us);
+
+	mdio_nl_lock(xfer);
+
+	for (i = 0; i < n; i++) {
+		if (ktime_after(ktime_get(), deadline)) {
+			ret = -ETIMEDOUT;
+			break;
 		}
+
+		ret = mdio_nl_write_one(xfer, &writes[i], i, verify);
+		if (ret < 0)
+			break;
 	}
-exit:
+
 	mutex_unlock(&xfer->mdio->mdio_lock);
 	return ret;
 }
 
-struct mdio_nl_op_proto {
-	u8 arg0;
-	u8 arg1;
-	u8 arg2;
-};
-
-static const struct mdio_nl_op_proto mdio_nl_op_protos[MDIO_NL_OP_MAX + 1] = {
-	[MDIO_NL_OP_READ] = {
-		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg2 = BIT(MDIO_NL_ARG_REG),
-	},
-	[MDIO_NL_OP_WRITE] = {
-		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg2 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-	},
-	[MDIO_NL_OP_AND] = {
-		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg2 = BIT(MDIO_NL_ARG_REG),
-	},
-	[MDIO_NL_OP_OR] = {
-		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg2 = BIT(MDIO_NL_ARG_REG),
-	},
-	[MDIO_NL_OP_ADD] = {
-		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg2 = BIT(MDIO_NL_ARG_REG),
-	},
-	[MDIO_NL_OP_JEQ] = {
-		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg2 = BIT(MDIO_NL_ARG_IMM),
-	},
-	[MDIO_NL_OP_JNE] = {
-		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg2 = BIT(MDIO_NL_ARG_IMM),
-	},
-	[MDIO_NL_OP_EMIT] = {
-		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
-		.arg1 = BIT(MDIO_NL_ARG_NONE),
-		.arg2 = BIT(MDIO_NL_ARG_NONE),
-	},
-};
-
 static int mdio_nl_validate_insn(const struct nlattr *attr,
 				 struct netlink_ext_ack *extack,
 				 const struct mdio_nl_insn *insn)
 {
-	const struct mdio_nl_op_proto *proto;
-
-	if (insn->op > MDIO_NL_OP_MAX) {
+	switch (mdio_vm_check_insn(insn)) {
+	case MDIO_VM_OK:
+		return 0;
+	case MDIO_VM_ILLEGAL:
 		NL_SET_ERR_MSG_ATTR(extack, attr, "Illegal instruction");
-		return -EINVAL;
-	}
-
-	proto = &mdio_nl_op_protos[insn->op];
-
-	if (!(BIT(insn->arg0 >> 16) & proto->arg0)) {
+		break;
+	case MDIO_VM_ARG0:
 		NL_SET_ERR_MSG_ATTR(extack, attr, "Argument 0 invalid");
-		return -EINVAL;
-	}
-
-	if (!(BIT(insn->arg1 >> 16) & proto->arg1)) {
+		break;
+	case MDIO_VM_ARG1:
 		NL_SET_ERR_MSG_ATTR(extack, attr, "Argument 1 invalid");
-		return -EINVAL;
-	}
-
-	if (!(BIT(insn->arg2 >> 16) & proto->arg2)) {
+		break;
+	case MDIO_VM_ARG2:
 		NL_SET_ERR_MSG_ATTR(extack, attr, "Argument 2 invalid");
-		return -EINVAL;
+		break;
 	}
 
-	return 0;
+	return -EINVAL;
 }
 
 static int mdio_nl_validate_prog(const struct nlattr *attr,
@@ -282,15 +526,97 @@ static int mdio_nl_validate_prog(const struct nlattr *attr,
 	return err;
 }
 
+static bool mdio_nl_reg_valid(u16 dev, u16 reg)
+{
+	if (mdio_phy_id_is_c45(dev))
+		return !(dev & ~(MDIO_PHY_ID_C45 |
+				 MDIO_PHY_ID_PRTAD |
+				 MDIO_PHY_ID_DEVAD));
+
+	return dev < PHY_MAX_ADDR && reg < 32;
+}
+
+static int mdio_nl_validate_regs(const struct nlattr *attr,
+				 struct netlink_ext_ack *extack)
+{
+	const struct mdio_nl_reg *regs = nla_data(attr);
+	int len = nla_len(attr);
+	int i;
+
+	if (!len || len % sizeof(*regs)) {
+		NL_SET_ERR_MSG_ATTR(extack, attr, "Unaligned register list");
+		return -EINVAL;
+	}
+
+	len /= sizeof(*regs);
+	for (i = 0; i < len; i++) {
+		if (!mdio_nl_reg_valid(regs[i].dev, regs[i].reg)) {
+			NL_SET_ERR_MSG_ATTR(extack, attr,
+					    "Register out of range");
+			return -ERANGE;
+		}
+	}
+
+	return 0;
+}
+
+static int mdio_nl_validate_writes(const struct nlattr *attr,
+				   struct netlink_ext_ack *extack)
+{
+	const struct mdio_nl_write *writes = nla_data(attr);
+	int len = nla_len(attr);
+	int i;
+
+	if (!len || len % sizeof(*writes)) {
+		NL_SET_ERR_MSG_ATTR(extack, attr, "Unaligned write list");
+		return -EINVAL;
+	}
+
+	len /= sizeof(*writes);
+	for (i = 0; i < len; i++) {
+		if (!mdio_nl_reg_valid(writes[i].dev, writes[i].reg)) {
+			NL_SET_ERR_MSG_ATTR(extack, attr,
+					    "Register out of range");
+			return -ERANGE;
+		}
+	}
+
+	return 0;
+}
+
 static const struct nla_policy mdio_nl_policy[MDIO_NLA_MAX + 1] = {
 	[MDIO_NLA_UNSPEC]  = { .type = NLA_UNSPEC, },
 	[MDIO_NLA_BUS_ID]  = { .type = NLA_STRING, .len = MII_BUS_ID_SIZE },
-	[MDIO_NLA_TIMEOUT] = NLA_POLICY_MAX(NLA_U16, 10 * MSEC_PER_SEC),
+	[MDIO_NLA_TIMEOUT] = NLA_POLICY_MAX(NLA_U16, MDIO_NL_TIMEOUT_MAX),
 	[MDIO_NLA_PROG]    = NLA_POLICY_VALIDATE_FN(NLA_BINARY,
 						    mdio_nl_validate_prog,
-						    0x1000),
+						    MDIO_NL_PROG_MAX),
 	[MDIO_NLA_DATA]    = { .type = NLA_NESTED },
 	[MDIO_NLA_ERROR]   = { .type = NLA_S32, },
+	[MDIO_NLA_PAD]     = { .type = NLA_UNSPEC, },
+	[MDIO_NLA_RATE]    = { .type = NLA_U32, },
+	[MDIO_NLA_BURST]   = NLA_POLICY_MIN(NLA_U32, 1),
+	[MDIO_NLA_THROTTLED]    = { .type = NLA_U64, },
+	[MDIO_NLA_THROTTLED_NS] = { .type = NLA_U64, },
+	[MDIO_NLA_BUS_CAPS]     = { .type = NLA_U32, },
+	[MDIO_NLA_BUS_CLOCK]    = { .type = NLA_U32, },
+	[MDIO_NLA_ISA]          = { .type = NLA_U32, },
+	[MDIO_NLA_PROG_MAX]     = { .type = NLA_U32, },
+	[MDIO_NLA_TIMEOUT_MAX]  = { .type = NLA_U32, },
+	[MDIO_NLA_BUS_HANDLE]   = NLA_POLICY_MIN(NLA_U32, 1),
+	[MDIO_NLA_REGS]         = NLA_POLICY_VALIDATE_FN(NLA_BINARY,
+							 mdio_nl_validate_regs,
+							 MDIO_NL_PROG_MAX),
+	[MDIO_NLA_WRITES]       = NLA_POLICY_VALIDATE_FN(NLA_BINARY,
+							 mdio_nl_validate_writes,
+							 MDIO_NL_PROG_MAX),
+	[MDIO_NLA_VERIFY]       = { .type = NLA_FLAG, },
+	[MDIO_NLA_FLAGS]        = NLA_POLICY_MAX(NLA_U32, MDIO_NL_F_MASK),
+	[MDIO_NLA_REPORT]       = { .type = NLA_BINARY,
+				    .len = sizeof(struct mdio_nl_report) },
+	[MDIO_NLA_TIMEOUT_US]   = { .type = NLA_U32, },
+	[MDIO_NLA_STATE]        = { .type = NLA_BINARY,
+				    .len = sizeof(struct mdio_nl_state) },
 };
 
 static struct genl_family mdio_nl_family;
@@ -307,7 +633,8 @@ static int mdio_nl_open(struct mdio_nl_xfer *xfer)
 
 	xfer->hdr = genlmsg_put(xfer->msg, xfer->info->snd_portid,
 				xfer->info->snd_seq, &mdio_nl_family,
-				NLM_F_ACK | NLM_F_MULTI, MDIO_GENL_XFER);
+				NLM_F_ACK | NLM_F_MULTI,
+				xfer->info->genlhdr->cmd);
 	if (!xfer->hdr) {
 		err = -EMSGSIZE;
 		goto err_free;
@@ -327,6 +654,41 @@ err:
 	return err;
 }
 
+/* Put an attribute in the final reply, flushing out the data that
+ * preceded it if needed to make room. */
+static int mdio_nl_put_last(struct mdio_nl_xfer *xfer, int attrtype,
+			    int len, const void *data)
+{
+	int err;
+
+	if (!nla_put_64bit(xfer->msg, attrtype, len, data, MDIO_NLA_PAD))
+		return 0;
+
+	err = mdio_nl_flush(xfer);
+	if (err)
+		return err;
+
+	if (nla_put_64bit(xfer->msg, attrtype, len, data, MDIO_NLA_PAD))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
+static int mdio_nl_put_report(struct mdio_nl_xfer *xfer)
+{
+	struct mdio_nl_report report = {
+		.insns = xfer->vm.insns,
+		.reads = xfer->reads,
+		.writes = xfer->writes,
+		.frames = xfer->frames,
+		.lock_ns = xfer->lock_ns,
+		.eval_ns = xfer->eval_ns,
+	};
+
+	return mdio_nl_put_last(xfer, MDIO_NLA_REPORT, sizeof(report),
+				&report);
+}
+
 static int mdio_nl_close(struct mdio_nl_xfer *xfer, bool last, int xerr)
 {
 	struct nlmsghdr *end;
@@ -334,6 +696,19 @@ static int mdio_nl_close(struct mdio_nl_xfer *xfer, bool last, int xerr)
 
 	nla_nest_end(xfer->msg, xfer->data);
 
+	if (last && (xfer->vm.flags & MDIO_NL_F_REPORT)) {
+		err = mdio_nl_put_report(xfer);
+		if (err)
+			goto err_free;
+	}
+
+	if (last && xfer->vm.stopped) {
+		err = mdio_nl_put_last(xfer, MDIO_NLA_STATE,
+				       sizeof(xfer->vm.state), &xfer->vm.state);
+		if (err)
+			goto err_free;
+	}
+
 	if (xerr && nla_put_s32(xfer->msg, MDIO_NLA_ERROR, xerr)) {
 		err = mdio_nl_flush(xfer);
 		if (err)
@@ -374,52 +749,1283 @@ err_free:
 	return err;
 }
 
-static int mdio_nl_cmd_xfer(struct sk_buff *skb, struct genl_info *info)
+static struct mdio_nl_bus *mdio_nl_bus_find(const char *id)
 {
-	struct mdio_nl_xfer xfer;
-	int err;
+	struct mdio_nl_bus *bus;
 
-	if (!info->attrs[MDIO_NLA_BUS_ID] ||
-	    !info->attrs[MDIO_NLA_PROG]   ||
-	     info->attrs[MDIO_NLA_DATA]   ||
-	     info->attrs[MDIO_NLA_ERROR])
-		return -EINVAL;
+	lockdep_assert_held(&mdio_nl_buses_lock);
 
-	xfer.mdio = mdio_find_bus(nla_data(info->attrs[MDIO_NLA_BUS_ID]));
-	if (!xfer.mdio)
-		return -ENODEV;
+	list_for_each_entry(bus, &mdio_nl_buses, node) {
+		if (!strcmp(bus->id, id))
+			return bus;
+	}
 
-	if (info->attrs[MDIO_NLA_TIMEOUT])
-		xfer.timeout_ms = nla_get_u32(info->attrs[MDIO_NLA_TIMEOUT]);
-	else
-		xfer.timeout_ms = 100;
+	return NULL;
+}
 
-	xfer.info = info;
-	xfer.prog_len = nla_len(info->attrs[MDIO_NLA_PROG]) / sizeof(*xfer.prog);
-	xfer.prog = nla_data(info->attrs[MDIO_NLA_PROG]);
+static struct mdio_nl_bus *mdio_nl_bus_get(struct mii_bus *mdio)
+{
+	struct mdio_nl_bus *bus;
+
+	mutex_lock(&mdio_nl_buses_lock);
+
+	bus = mdio_nl_bus_find(mdio->id);
+	if (bus)
+		goto out_get;
+
+	bus = kzalloc(sizeof(*bus), GFP_KERNEL);
+	if (!bus)
+		goto out;
+
+	/* The initial reference is owned by the list. */
+	kref_init(&bus->kref);
+	strscpy(bus->id, mdio->id, sizeof(bus->id));
+	mutex_init(&bus->throttle_lock);
+	spin_lock_init(&bus->lock);
+	INIT_DELAYED_WORK(&bus->fw_work, mdio_nl_fw_work);
+	mutex_init(&bus->share_lock);
+	INIT_LIST_HEAD(&bus->shares);
+	list_add_tail(&bus->node, &mdio_nl_buses);
+
+out_get:
+	kref_get(&bus->kref);
+out:
+	mutex_unlock(&mdio_nl_buses_lock);
+	return bus;
+}
 
-	err = mdio_nl_open(&xfer);
-	if (err)
-		goto out_put;
+static void mdio_nl_share_release(struct kref *kref)
+{
+	struct mdio_nl_share *share = container_of(kref, struct mdio_nl_share,
+						   kref);
 
-	err = mdio_nl_eval(&xfer);
+	kfree(share->prog);
+	kfree(share);
+}
 
-	err = mdio_nl_close(&xfer, true, err);
+static void mdio_nl_share_put(struct mdio_nl_share *share)
+{
+	kref_put(&share->kref, mdio_nl_share_release);
+}
 
-out_put:
-	put_device(&xfer.mdio->dev);
-	return err;
+static void mdio_nl_bus_release(struct kref *kref)
+{
+	struct mdio_nl_bus *bus = container_of(kref, struct mdio_nl_bus, kref);
+	struct mdio_nl_share *share, *tmp;
+
+	list_for_each_entry_safe(share, tmp, &bus->shares, node)
+		mdio_nl_share_put(share);
+
+	kfree(bus);
 }
 
-static const struct genl_ops mdio_nl_ops[] = {
-	{
-		.cmd = MDIO_GENL_XFER,
-		.doit = mdio_nl_cmd_xfer,
-		.flags = GENL_ADMIN_PERM,
-	},
-};
+static void mdio_nl_bus_put(struct mdio_nl_bus *bus)
+{
+	kref_put(&bus->kref, mdio_nl_bus_release);
+}
 
-static struct genl_family mdio_nl_family = {
+static void mdio_nl_bus_unlink(struct mdio_nl_bus *bus)
+{
+	lockdep_assert_held(&mdio_nl_buses_lock);
+
+	if (bus->handle) {
+		idr_remove(&mdio_nl_handles, bus->handle);
+		bus->handle = 0;
+		bus->mdio = NULL;
+	}
+
+	list_del(&bus->node);
+	mdio_nl_bus_put(bus);
+}
+
+static void mdio_nl_bus_add(struct mii_bus *mdio)
+{
+	struct mdio_nl_bus *bus;
+	int handle;
+
+	bus = mdio_nl_bus_get(mdio);
+	if (!bus)
+		return;
+
+	mutex_lock(&mdio_nl_buses_lock);
+
+	if (!bus->handle) {
+		/* Cycle through the space, so that a stale handle is
+		 * unlikely to resolve to a newly added bus. */
+		handle = idr_alloc_cyclic(&mdio_nl_handles, bus, 1, INT_MAX,
+					  GFP_KERNEL);
+		if (handle > 0) {
+			bus->handle = handle;
+			bus->mdio = mdio;
+
+			/* Probing may be going on in parallel, so
+			 * don't hold up anything else. */
+			if (mdio_nl_fw)
+				queue_delayed_work(system_unbound_wq,
+						   &bus->fw_work, 0);
+		}
+	}
+
+	mutex_unlock(&mdio_nl_buses_lock);
+
+	/* Opening the device takes misc_mtx before any of our locks,
+	 * so it must be registered without holding them. */
+	if (mdio_nl_chardev && bus->handle)
+		mdio_nl_cdev_add(bus);
+
+	mdio_nl_bus_put(bus);
+}
+
+static void mdio_nl_bus_del(struct mii_bus *mdio)
+{
+	struct mdio_nl_bus *bus;
+
+	mutex_lock(&mdio_nl_buses_lock);
+
+	bus = mdio_nl_bus_find(mdio->id);
+	if (bus)
+		kref_get(&bus->kref);
+
+	mutex_unlock(&mdio_nl_buses_lock);
+
+	if (!bus)
+		return;
+
+	/* The firmware program must be done with the bus before it
+	 * goes away. */
+	cancel_delayed_work_sync(&bus->fw_work);
+	mdio_nl_cdev_del(bus);
+
+	mutex_lock(&mdio_nl_buses_lock);
+
+	if (mdio_nl_bus_find(mdio->id) == bus)
+		mdio_nl_bus_unlink(bus);
+
+	mutex_unlock(&mdio_nl_buses_lock);
+
+	mdio_nl_bus_put(bus);
+}
+
+static void mdio_nl_bus_put_all(void)
+{
+	struct mdio_nl_bus *bus, *tmp;
+
+	mutex_lock(&mdio_nl_buses_lock);
+
+	list_for_each_entry_safe(bus, tmp, &mdio_nl_buses, node)
+		mdio_nl_bus_unlink(bus);
+
+	mutex_unlock(&mdio_nl_buses_lock);
+
+	idr_destroy(&mdio_nl_handles);
+}
+
+static u32 mdio_nl_bus_handle(struct mii_bus *mdio)
+{
+	struct mdio_nl_bus *bus;
+	u32 handle = 0;
+
+	mutex_lock(&mdio_nl_buses_lock);
+
+	bus = mdio_nl_bus_find(mdio->id);
+	if (bus)
+		handle = bus->handle;
+
+	mutex_unlock(&mdio_nl_buses_lock);
+	return handle;
+}
+
+/* Resolve the bus targeted by a request, preferably by its handle,
+ * which avoids searching through all devices in the mdio_bus
+ * class. On success, references to both the bus and its state are
+ * held. */
+static struct mdio_nl_bus *mdio_nl_bus_lookup(struct genl_info *info,
+					      struct mii_bus **mdiop)
+{
+	struct mdio_nl_bus *bus;
+	struct mii_bus *mdio;
+
+	if (info->attrs[MDIO_NLA_BUS_HANDLE]) {
+		mutex_lock(&mdio_nl_buses_lock);
+
+		bus = idr_find(&mdio_nl_handles,
+			       nla_get_u32(info->attrs[MDIO_NLA_BUS_HANDLE]));
+		if (bus) {
+			kref_get(&bus->kref);
+			get_device(&bus->mdio->dev);
+			*mdiop = bus->mdio;
+		}
+
+		mutex_unlock(&mdio_nl_buses_lock);
+		return bus ? : ERR_PTR(-ENODEV);
+	}
+
+	if (!info->attrs[MDIO_NLA_BUS_ID])
+		return ERR_PTR(-EINVAL);
+
+	mdio = mdio_find_bus(nla_data(info->attrs[MDIO_NLA_BUS_ID]));
+	if (!mdio)
+		return ERR_PTR(-ENODEV);
+
+	bus = mdio_nl_bus_get(mdio);
+	if (!bus) {
+		put_device(&mdio->dev);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	*mdiop = mdio;
+	return bus;
+}
+
+/* The rate limiter is a token bucket, where the tokens are measured
+ * in nanoseconds of bus time. Each operation costs 1s/rate, and the
+ * bucket holds at most burst operations worth of time. Transfers are
+ * allowed to start as long as the bus is not in debt, and are charged
+ * for the operations they performed once they are done. */
+static u64 mdio_nl_bus_cost(struct mdio_nl_bus *bus)
+{
+	return div_u64(NSEC_PER_SEC, bus->rate);
+}
+
+static s64 mdio_nl_bus_refill(struct mdio_nl_bus *bus)
+{
+	ktime_t now = ktime_get();
+	s64 debt = 0;
+
+	spin_lock(&bus->lock);
+
+	if (bus->rate) {
+		bus->credit_ns += ktime_to_ns(ktime_sub(now, bus->stamp));
+		bus->credit_ns = min_t(s64, bus->credit_ns,
+				       bus->burst * mdio_nl_bus_cost(bus));
+
+		if (bus->credit_ns < 0)
+			debt = -bus->credit_ns;
+	}
+
+	bus->stamp = now;
+	spin_unlock(&bus->lock);
+	return debt;
+}
+
+static void mdio_nl_bus_charge(struct mdio_nl_bus *bus, u32 ops)
+{
+	spin_lock(&bus->lock);
+
+	if (bus->rate)
+		bus->credit_ns -= ops * mdio_nl_bus_cost(bus);
+
+	spin_unlock(&bus->lock);
+}
+
+static int mdio_nl_bus_throttle(struct mdio_nl_bus *bus)
+{
+	bool throttled = false;
+	ktime_t start, expires;
+	s64 debt;
+	int err;
+
+	if (!READ_ONCE(bus->rate))
+		return 0;
+
+	err = mutex_lock_interruptible(&bus->throttle_lock);
+	if (err)
+		return err;
+
+	start = ktime_get();
+
+	while ((debt = mdio_nl_bus_refill(bus)) > 0) {
+		throttled = true;
+
+		expires = ns_to_ktime(debt);
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule_hrtimeout(&expires, HRTIMER_MODE_REL);
+
+		if (signal_pending(current)) {
+			err = -EINTR;
+			break;
+		}
+	}
+
+	if (throttled) {
+		spin_lock(&bus->lock);
+		bus->throttled++;
+		bus->throttled_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+		spin_unlock(&bus->lock);
+	}
+
+	mutex_unlock(&bus->throttle_lock);
+	return err;
+}
+
+static int mdio_nl_parse_timeout(struct mdio_nl_xfer *xfer)
+{
+	struct nlattr **attrs = xfer->info->attrs;
+
+	if (attrs[MDIO_NLA_TIMEOUT] && attrs[MDIO_NLA_TIMEOUT_US])
+		return -EINVAL;
+
+	if (attrs[MDIO_NLA_TIMEOUT_US]) {
+		xfer->vm.timeout_us = nla_get_u32(attrs[MDIO_NLA_TIMEOUT_US]);
+		if (xfer->vm.timeout_us > MDIO_NL_TIMEOUT_MAX * USEC_PER_MSEC)
+			return -ERANGE;
+	} else if (attrs[MDIO_NLA_TIMEOUT]) {
+		xfer->vm.timeout_us = nla_get_u16(attrs[MDIO_NLA_TIMEOUT]) *
+			USEC_PER_MSEC;
+	} else {
+		xfer->vm.timeout_us = 100 * USEC_PER_MSEC;
+	}
+
+	return 0;
+}
+
+static int mdio_nl_parse_state(struct mdio_nl_xfer *xfer)
+{
+	struct nlattr *attr = xfer->info->attrs[MDIO_NLA_STATE];
+
+	if (!attr)
+		return 0;
+
+	if (nla_len(attr) != sizeof(xfer->vm.state))
+		return -EINVAL;
+
+	memcpy(&xfer->vm.state, nla_data(attr), sizeof(xfer->vm.state));
+
+	if (xfer->vm.state.pc >= xfer->vm.prog_len ||
+	    !mdio_vm_state_valid(&xfer->vm))
+		return -EINVAL;
+
+	return 0;
+}
+
+static bool mdio_nl_xfer_can_share(struct mdio_nl_xfer *xfer)
+{
+	int i;
+
+	/* Resumed programs, and reports, are specific to a caller */
+	if (xfer->vm.flags & ~MDIO_NL_F_NONFATAL ||
+	    xfer->info->attrs[MDIO_NLA_STATE])
+		return false;
+
+	for (i = 0; i < xfer->vm.prog_len; i++) {
+		switch (xfer->vm.prog[i].op) {
+		case MDIO_NL_OP_WRITE:
+		case MDIO_NL_OP_MMD_WRITE:
+		case MDIO_NL_OP_PAGE:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Find a recent execution of the same read-only program on bus,
+ * which started no more than window_us ago. If there is none, the
+ * caller becomes the leader of a new one, and must execute the
+ * program and call mdio_nl_share_done(). */
+static struct mdio_nl_share *mdio_nl_share_get(struct mdio_nl_bus *bus,
+					       struct mdio_nl_xfer *xfer,
+					       u32 window_us, bool *leader)
+{
+	struct mdio_nl_share *share, *tmp;
+	ktime_t now = ktime_get();
+
+	mutex_lock(&bus->share_lock);
+
+	list_for_each_entry_safe(share, tmp, &bus->shares, node) {
+		if (ktime_us_delta(now, share->start) > window_us ||
+		    (completion_done(&share->done) && !share->valid)) {
+			list_del(&share->node);
+			mdio_nl_share_put(share);
+			continue;
+		}
+
+		if (share->flags == xfer->vm.flags &&
+		    share->prog_len == xfer->vm.prog_len &&
+		    !memcmp(share->prog, xfer->vm.prog,
+			    xfer->vm.prog_len * sizeof(*xfer->vm.prog))) {
+			kref_get(&share->kref);
+			*leader = false;
+			goto out;
+		}
+	}
+
+	share = kzalloc(sizeof(*share), GFP_KERNEL);
+	if (!share)
+		goto out;
+
+	share->prog = kmemdup(xfer->vm.prog,
+			      xfer->vm.prog_len * sizeof(*xfer->vm.prog),
+			      GFP_KERNEL);
+	if (!share->prog) {
+		kfree(share);
+		share = NULL;
+		goto out;
+	}
+
+	share->start = now;
+	share->flags = xfer->vm.flags;
+	share->prog_len = xfer->vm.prog_len;
+	init_completion(&share->done);
+
+	/* One reference for the list, one for the leader */
+	kref_init(&share->kref);
+	kref_get(&share->kref);
+	list_add_tail(&share->node, &bus->shares);
+	*leader = true;
+out:
+	mutex_unlock(&bus->share_lock);
+	return share;
+}
+
+static void mdio_nl_share_done(struct mdio_nl_share *share, int err,
+			       bool valid)
+{
+	if (!share)
+		return;
+
+	share->err = err;
+	share->valid = valid && share->len <= MDIO_NL_SHARE_MAX;
+	complete_all(&share->done);
+	mdio_nl_share_put(share);
+}
+
+/* Reply with the outcome of the leader's execution. If there is
+ * nothing to share, *replayed is cleared and the caller should
+ * execute the program on its own. Errors can not be used to signal
+ * that, since they may stem from the leader, or from a reply that
+ * has already been partially sent. */
+static int mdio_nl_share_replay(struct mdio_nl_xfer *xfer,
+				struct mdio_nl_share *share, bool *replayed)
+{
+	int err, i;
+
+	*replayed = false;
+
+	err = wait_for_completion_killable(&share->done);
+	if (err)
+		return err;
+
+	if (!share->valid)
+		return 0;
+
+	*replayed = true;
+
+	err = mdio_nl_open(xfer);
+	if (err)
+		return err;
+
+	for (i = 0; i < share->len; i++) {
+		err = mdio_nl_emit(xfer, share->data[i]);
+		if (err)
+			break;
+	}
+
+	return mdio_nl_close(xfer, true, err ? : share->err);
+}
+
+static int mdio_nl_cmd_xfer(struct sk_buff *skb, struct genl_info *info)
+{
+	struct mdio_nl_xfer xfer = { .info = info };
+	struct mdio_nl_share *share = NULL;
+	struct mdio_nl_bus *bus;
+	bool leader = false;
+	bool replayed;
+	u32 window_us;
+	u64 start;
+	int err;
+
+	if (!info->attrs[MDIO_NLA_PROG] ||
+	     info->attrs[MDIO_NLA_DATA] ||
+	     info->attrs[MDIO_NLA_ERROR])
+		return -EINVAL;
+
+	bus = mdio_nl_bus_lookup(info, &xfer.mdio);
+	if (IS_ERR(bus))
+		return PTR_ERR(bus);
+
+	xfer.vm.flags = info->attrs[MDIO_NLA_FLAGS] ?
+		nla_get_u32(info->attrs[MDIO_NLA_FLAGS]) : 0;
+	xfer.vm.prog_len = nla_len(info->attrs[MDIO_NLA_PROG]) /
+		sizeof(*xfer.vm.prog);
+	xfer.vm.prog = nla_data(info->attrs[MDIO_NLA_PROG]);
+
+	err = mdio_nl_parse_timeout(&xfer);
+	if (err)
+		goto out_bus_put;
+
+	err = mdio_nl_parse_state(&xfer);
+	if (err)
+		goto out_bus_put;
+
+	window_us = READ_ONCE(mdio_nl_coalesce_us);
+	if (window_us && mdio_nl_xfer_can_share(&xfer))
+		share = mdio_nl_share_get(bus, &xfer, window_us, &leader);
+
+	if (share && !leader) {
+		err = mdio_nl_share_replay(&xfer, share, &replayed);
+		mdio_nl_share_put(share);
+		share = NULL;
+
+		if (err || replayed)
+			goto out_bus_put;
+	}
+
+	err = mdio_nl_bus_throttle(bus);
+	if (err)
+		goto out_share;
+
+	err = mdio_nl_open(&xfer);
+	if (err)
+		goto out_share;
+
+	xfer.share = share;
+
+	start = ktime_get_ns();
+	err = mdio_vm_eval(&xfer.vm);
+	xfer.eval_ns = ktime_get_ns() - start;
+	mdio_nl_bus_charge(bus, xfer.reads + xfer.writes);
+
+	/* Let everyone waiting for us go as soon as possible. A fatal
+	 * signal says nothing about the outcome for them. */
+	mdio_nl_share_done(share, err, err != -EINTR && !xfer.vm.stopped);
+	share = NULL;
+
+	err = mdio_nl_close(&xfer, true, err);
+
+out_share:
+	mdio_nl_share_done(share, err, false);
+out_bus_put:
+	mdio_nl_bus_put(bus);
+	put_device(&xfer.mdio->dev);
+	return err;
+}
+
+/* Shared by READ_LIST and WRITE_LIST */
+static int mdio_nl_cmd_list(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr *list;
+	struct mdio_nl_xfer xfer = { .info = info };
+	struct mdio_nl_bus *bus;
+	u64 start;
+	int err;
+
+	if (info->genlhdr->cmd == MDIO_GENL_WRITE_LIST)
+		list = info->attrs[MDIO_NLA_WRITES];
+	else
+		list = info->attrs[MDIO_NLA_REGS];
+
+	if (!list)
+		return -EINVAL;
+
+	bus = mdio_nl_bus_lookup(info, &xfer.mdio);
+	if (IS_ERR(bus))
+		return PTR_ERR(bus);
+
+	xfer.vm.flags = info->attrs[MDIO_NLA_FLAGS] ?
+		nla_get_u32(info->attrs[MDIO_NLA_FLAGS]) : 0;
+
+	err = mdio_nl_parse_timeout(&xfer);
+	if (err)
+		goto out_bus_put;
+
+	err = mdio_nl_bus_throttle(bus);
+	if (err)
+		goto out_bus_put;
+
+	err = mdio_nl_open(&xfer);
+	if (err)
+		goto out_bus_put;
+
+	start = ktime_get_ns();
+	if (info->genlhdr->cmd == MDIO_GENL_WRITE_LIST)
+		err = mdio_nl_write_list(&xfer, nla_data(list),
+					 nla_len(list) /
+					 sizeof(struct mdio_nl_write),
+					 nla_get_flag(info->attrs[MDIO_NLA_VERIFY]));
+	else
+		err = mdio_nl_read_list(&xfer, nla_data(list),
+					nla_len(list) /
+					sizeof(struct mdio_nl_reg));
+	xfer.eval_ns = ktime_get_ns() - start;
+
+	mdio_nl_bus_charge(bus, xfer.reads + xfer.writes);
+
+	err = mdio_nl_close(&xfer, true, err);
+
+out_bus_put:
+	mdio_nl_bus_put(bus);
+	put_device(&xfer.mdio->dev);
+	return err;
+}
+
+static int mdio_nl_cmd_rate(struct sk_buff *skb, struct genl_info *info)
+{
+	struct mdio_nl_bus *bus;
+	struct mii_bus *mdio;
+	struct sk_buff *msg;
+	void *hdr;
+	int err;
+
+	if (info->attrs[MDIO_NLA_BURST] && !info->attrs[MDIO_NLA_RATE])
+		return -EINVAL;
+
+	bus = mdio_nl_bus_lookup(info, &mdio);
+	if (IS_ERR(bus))
+		return PTR_ERR(bus);
+
+	msg = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	if (!msg) {
+		err = -ENOMEM;
+		goto out_bus_put;
+	}
+
+	hdr = genlmsg_put_reply(msg, info, &mdio_nl_family, 0, MDIO_GENL_RATE);
+	if (!hdr) {
+		err = -EMSGSIZE;
+		goto err_free;
+	}
+
+	spin_lock(&bus->lock);
+
+	if (info->attrs[MDIO_NLA_RATE]) {
+		bus->rate = nla_get_u32(info->attrs[MDIO_NLA_RATE]);
+
+		if (info->attrs[MDIO_NLA_BURST])
+			bus->burst = nla_get_u32(info->attrs[MDIO_NLA_BURST]);
+		else
+			bus->burst = 1 + bus->rate / 10;
+
+		bus->credit_ns = bus->rate ?
+			bus->burst * mdio_nl_bus_cost(bus) : 0;
+		bus->stamp = ktime_get();
+	}
+
+	err = nla_put_string(msg, MDIO_NLA_BUS_ID, bus->id) ||
+		nla_put_u32(msg, MDIO_NLA_RATE, bus->rate) ||
+		nla_put_u32(msg, MDIO_NLA_BURST, bus->burst) ||
+		nla_put_u64_64bit(msg, MDIO_NLA_THROTTLED, bus->throttled,
+				  MDIO_NLA_PAD) ||
+		nla_put_u64_64bit(msg, MDIO_NLA_THROTTLED_NS, bus->throttled_ns,
+				  MDIO_NLA_PAD);
+
+	spin_unlock(&bus->lock);
+
+	if (err) {
+		err = -EMSGSIZE;
+		goto err_free;
+	}
+
+	genlmsg_end(msg, hdr);
+	err = genlmsg_reply(msg, info);
+	goto out_bus_put;
+
+err_free:
+	nlmsg_free(msg);
+out_bus_put:
+	mdio_nl_bus_put(bus);
+	put_device(&mdio->dev);
+	return err;
+}
+
+/* phylib does not export the mdio_bus class, which is needed in
+ * order to enumerate buses. It is looked up when the module is
+ * loaded, see mdio_nl_class_find(). */
+static struct class *mdio_nl_class;
+
+static u32 mdio_nl_bus_caps(struct mii_bus *mdio)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,3,0)
+	/* Before v6.3, C22 and C45 accesses were funneled through
+	 * the same callbacks, leaving it up to the driver to reject
+	 * the ones it does not support. */
+	return BIT(MDIO_NL_BUS_CAP_C22) | BIT(MDIO_NL_BUS_CAP_C45);
+#else
+	u32 caps = 0;
+
+	if (mdio->read)
+		caps |= BIT(MDIO_NL_BUS_CAP_C22);
+	if (mdio->read_c45)
+		caps |= BIT(MDIO_NL_BUS_CAP_C45);
+
+	return caps;
+#endif
+}
+
+static int mdio_nl_fill_bus(struct sk_buff *msg, struct mii_bus *mdio,
+			    u32 portid, u32 seq, int flags, u8 cmd)
+{
+	u32 handle, hz;
+	void *hdr;
+
+	hdr = genlmsg_put(msg, portid, seq, &mdio_nl_family, flags, cmd);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	if (nla_put_string(msg, MDIO_NLA_BUS_ID, mdio->id) ||
+	    nla_put_u32(msg, MDIO_NLA_BUS_CAPS, mdio_nl_bus_caps(mdio)) ||
+	    nla_put_u32(msg, MDIO_NLA_ISA, GENMASK(MDIO_NL_OP_MAX, 1)) ||
+	    nla_put_u32(msg, MDIO_NLA_FLAGS, MDIO_NL_F_MASK) ||
+	    nla_put_u32(msg, MDIO_NLA_PROG_MAX,
+			MDIO_NL_PROG_MAX / sizeof(struct mdio_nl_insn)) ||
+	    nla_put_u32(msg, MDIO_NLA_TIMEOUT_MAX, MDIO_NL_TIMEOUT_MAX))
+		goto err_cancel;
+
+	handle = mdio_nl_bus_handle(mdio);
+	if (handle && nla_put_u32(msg, MDIO_NLA_BUS_HANDLE, handle))
+		goto err_cancel;
+
+	/* The bus clock is not tracked by phylib, but most buses
+	 * described by firmware will have it as a property. */
+	if (!device_property_read_u32(&mdio->dev, "clock-frequency", &hz) &&
+	    nla_put_u32(msg, MDIO_NLA_BUS_CLOCK, hz))
+		goto err_cancel;
+
+	genlmsg_end(msg, hdr);
+	return 0;
+
+err_cancel:
+	genlmsg_cancel(msg, hdr);
+	return -EMSGSIZE;
+}
+
+static int mdio_nl_cmd_get_buses(struct sk_buff *skb, struct genl_info *info)
+{
+	struct mii_bus *mdio;
+	struct sk_buff *msg;
+	int err;
+
+	if (!info->attrs[MDIO_NLA_BUS_ID])
+		return -EINVAL;
+
+	mdio = mdio_find_bus(nla_data(info->attrs[MDIO_NLA_BUS_ID]));
+	if (!mdio)
+		return -ENODEV;
+
+	msg = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	if (!msg) {
+		err = -ENOMEM;
+		goto out_put;
+	}
+
+	err = mdio_nl_fill_bus(msg, mdio, info->snd_portid, info->snd_seq,
+			       0, MDIO_GENL_GET_BUSES);
+	if (err) {
+		nlmsg_free(msg);
+		goto out_put;
+	}
+
+	err = genlmsg_reply(msg, info);
+
+out_put:
+	put_device(&mdio->dev);
+	return err;
+}
+
+static int mdio_nl_dump_buses(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct class_dev_iter iter;
+	struct device *dev;
+	int err = 0, idx = 0;
+
+	if (!mdio_nl_class)
+		return -EOPNOTSUPP;
+
+	class_dev_iter_init(&iter, mdio_nl_class, NULL, NULL);
+
+	while ((dev = class_dev_iter_next(&iter))) {
+		if (idx < cb->args[0]) {
+			idx++;
+			continue;
+		}
+
+		err = mdio_nl_fill_bus(skb, to_mii_bus(dev),
+				       NETLINK_CB(cb->skb).portid,
+				       cb->nlh->nlmsg_seq, NLM_F_MULTI,
+				       MDIO_GENL_GET_BUSES);
+		if (err)
+			break;
+
+		idx++;
+	}
+
+	class_dev_iter_exit(&iter);
+
+	cb->args[0] = idx;
+
+	if (err && !skb->len)
+		return err;
+
+	return skb->len;
+}
+
+static const struct genl_multicast_group mdio_nl_mcgrps[] = {
+	[MDIO_NL_MCGRP_BUS] = { .name = MDIO_GENL_MCGRP_BUS_NAME, },
+};
+
+/* Only set while the family is registered, so that adding/removing
+ * the class interface at init/exit does not generate any events.
+ * Buses that existed before the module was loaded are thus not
+ * announced, while every bus added after that is. */
+static bool mdio_nl_notify_enabled;
+
+static void mdio_nl_notify(struct mii_bus *mdio, u8 cmd)
+{
+	struct sk_buff *msg;
+
+	if (!READ_ONCE(mdio_nl_notify_enabled))
+		return;
+
+	msg = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	if (!msg)
+		return;
+
+	if (mdio_nl_fill_bus(msg, mdio, 0, 0, 0, cmd)) {
+		nlmsg_free(msg);
+		return;
+	}
+
+	genlmsg_multicast(&mdio_nl_family, msg, 0, MDIO_NL_MCGRP_BUS,
+			  GFP_KERNEL);
+}
+
+static int mdio_nl_fw_validate(const struct firmware *fw)
+{
+	const struct mdio_nl_insn *prog = (const void *)fw->data;
+	size_t i;
+	int err;
+
+	if (!fw->size || fw->size % sizeof(*prog) ||
+	    fw->size > MDIO_NL_PROG_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < fw->size / sizeof(*prog); i++) {
+		err = mdio_nl_validate_insn(NULL, NULL, &prog[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/* Run a program once a bus has been registered and scanned, without
+ * waiting for userspace to come up. Programs use the same format as
+ * MDIO_NLA_PROG, anything they emit is discarded. */
+static int mdio_nl_fw_run(struct mdio_nl_bus *bus, const struct firmware *fw)
+{
+	struct mdio_nl_xfer xfer = {
+		.mdio = bus->mdio,
+		.vm = {
+			.prog = (void *)fw->data,
+			.prog_len = fw->size / sizeof(struct mdio_nl_insn),
+			.timeout_us = MDIO_NL_TIMEOUT_MAX * USEC_PER_MSEC,
+		},
+	};
+	int err;
+
+	err = mdio_nl_fw_validate(fw);
+	if (err)
+		return err;
+
+	err = mdio_vm_eval(&xfer.vm);
+	mdio_nl_bus_charge(bus, xfer.reads + xfer.writes);
+	return err;
+}
+
+static void mdio_nl_fw_work(struct work_struct *work)
+{
+	struct mdio_nl_bus *bus = container_of(to_delayed_work(work),
+					       struct mdio_nl_bus, fw_work);
+	const struct firmware *fw;
+	char name[MII_BUS_ID_SIZE + 20];
+	int err;
+
+	/* We learn about the bus as soon as its device is registered,
+	 * which is before it is reset and scanned for PHYs. Wait for
+	 * that to finish, so that the program runs after both. */
+	if (READ_ONCE(bus->mdio->state) != MDIOBUS_REGISTERED) {
+		queue_delayed_work(system_unbound_wq, &bus->fw_work,
+				   msecs_to_jiffies(MDIO_NL_FW_RETRY_MS));
+		return;
+	}
+
+	snprintf(name, sizeof(name), "mdio-netlink/%s.bin", bus->id);
+	strreplace(name + strlen("mdio-netlink/"), '/', '_');
+
+	/* Most buses won't have a program, so don't make a fuss. */
+	if (request_firmware_direct(&fw, name, &bus->mdio->dev))
+		return;
+
+	err = mdio_nl_fw_run(bus, fw);
+	if (err)
+		dev_err(&bus->mdio->dev, "%s failed (%d)\n", name, err);
+	else
+		dev_info(&bus->mdio->dev, "%s done\n", name);
+
+	release_firmware(fw);
+}
+
+/* Low overhead alternative to MDIO_GENL_XFER for high rate pollers,
+ * which avoids allocating, parsing and copying netlink messages. */
+struct mdio_nl_cdev {
+	struct miscdevice misc;
+	struct mdio_nl_bus *bus;
+
+	char name[MII_BUS_ID_SIZE + 8];
+	char nodename[MII_BUS_ID_SIZE + 8];
+};
+
+struct mdio_nl_file {
+	struct mdio_nl_bus *bus;
+
+	/* Serializes transfers, which are the ring's only producer */
+	struct mutex lock;
+	struct mdio_nl_ring *ring;
+};
+
+static size_t mdio_nl_ring_len(void)
+{
+	return PAGE_SIZE + MDIO_NL_RING_SIZE * sizeof(u32);
+}
+
+static int mdio_nl_cdev_open(struct inode *inode, struct file *file)
+{
+	struct mdio_nl_cdev *cdev = container_of(file->private_data,
+						 struct mdio_nl_cdev, misc);
+	struct mdio_nl_file *f;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f)
+		return -ENOMEM;
+
+	f->ring = vmalloc_user(mdio_nl_ring_len());
+	if (!f->ring) {
+		kfree(f);
+		return -ENOMEM;
+	}
+
+	f->ring->size = MDIO_NL_RING_SIZE;
+	f->ring->offset = PAGE_SIZE;
+	mutex_init(&f->lock);
+
+	/* misc_open() holds misc_mtx, so cdev, and by extension its
+	 * bus, can not go away under our feet. */
+	f->bus = cdev->bus;
+	kref_get(&f->bus->kref);
+
+	file->private_data = f;
+	return nonseekable_open(inode, file);
+}
+
+static int mdio_nl_cdev_release(struct inode *inode, struct file *file)
+{
+	struct mdio_nl_file *f = file->private_data;
+
+	mdio_nl_bus_put(f->bus);
+	vfree(f->ring);
+	kfree(f);
+	return 0;
+}
+
+static int mdio_nl_cdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct mdio_nl_file *f = file->private_data;
+
+	return remap_vmalloc_range(vma, f->ring, vma->vm_pgoff);
+}
+
+static int mdio_nl_cdev_prog(const struct mdio_nl_ioc_xfer *req,
+			     struct mdio_nl_insn **progp)
+{
+	struct mdio_nl_insn *prog;
+	int i, err;
+
+	if (!req->prog_len ||
+	    req->prog_len > MDIO_NL_PROG_MAX / sizeof(*prog))
+		return -EINVAL;
+
+	prog = memdup_user(u64_to_user_ptr(req->prog),
+			   req->prog_len * sizeof(*prog));
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	for (i = 0; i < req->prog_len; i++) {
+		err = mdio_nl_validate_insn(NULL, NULL, &prog[i]);
+		if (err) {
+			kfree(prog);
+			return err;
+		}
+	}
+
+	*progp = prog;
+	return 0;
+}
+
+static long mdio_nl_cdev_xfer(struct mdio_nl_file *f,
+			      const struct mdio_nl_ioc_xfer *req)
+{
+	struct mdio_nl_xfer xfer = {
+		.vm = {
+			.prog_len = req->prog_len,
+			.flags = req->flags,
+			.timeout_us = req->timeout_us ? : 100 * USEC_PER_MSEC,
+		},
+		.ring = f->ring,
+	};
+	struct mdio_nl_insn *prog;
+	struct mdio_nl_bus *bus = f->bus;
+	u32 head;
+	int err;
+
+	if (req->flags & ~MDIO_NL_F_NONFATAL || req->reserved)
+		return -EINVAL;
+
+	if (req->timeout_us > MDIO_NL_TIMEOUT_MAX * USEC_PER_MSEC)
+		return -ERANGE;
+
+	err = mdio_nl_cdev_prog(req, &prog);
+	if (err)
+		return err;
+
+	xfer.vm.prog = prog;
+
+	mutex_lock(&mdio_nl_buses_lock);
+	xfer.mdio = bus->mdio;
+	if (xfer.mdio)
+		get_device(&xfer.mdio->dev);
+	mutex_unlock(&mdio_nl_buses_lock);
+
+	if (!xfer.mdio) {
+		err = -ENODEV;
+		goto out_free;
+	}
+
+	err = mdio_nl_bus_throttle(bus);
+	if (err)
+		goto out_put;
+
+	mutex_lock(&f->lock);
+	head = READ_ONCE(f->ring->head);
+
+	err = mdio_vm_eval(&xfer.vm);
+	mdio_nl_bus_charge(bus, xfer.reads + xfer.writes);
+
+	if (!err)
+		err = READ_ONCE(f->ring->head) - head;
+
+	mutex_unlock(&f->lock);
+
+out_put:
+	put_device(&xfer.mdio->dev);
+out_free:
+	kfree(prog);
+	return err;
+}
+
+static long mdio_nl_cdev_ioctl(struct file *file, unsigned int cmd,
+			       unsigned long arg)
+{
+	struct mdio_nl_file *f = file->private_data;
+	struct mdio_nl_ioc_xfer req;
+
+	switch (cmd) {
+	case MDIO_NL_IOC_XFER:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+
+		return mdio_nl_cdev_xfer(f, &req);
+	}
+
+	return -ENOTTY;
+}
+
+static const struct file_operations mdio_nl_cdev_fops = {
+	.owner          = THIS_MODULE,
+	.open           = mdio_nl_cdev_open,
+	.release        = mdio_nl_cdev_release,
+	.mmap           = mdio_nl_cdev_mmap,
+	.unlocked_ioctl = mdio_nl_cdev_ioctl,
+	.compat_ioctl   = compat_ptr_ioctl,
+};
+
+static void mdio_nl_cdev_add(struct mdio_nl_bus *bus)
+{
+	struct mdio_nl_cdev *cdev;
+	int err;
+
+	if (bus->cdev)
+		return;
+
+	cdev = kzalloc(sizeof(*cdev), GFP_KERNEL);
+	if (!cdev)
+		return;
+
+	snprintf(cdev->name, sizeof(cdev->name), "mdio-%s", bus->id);
+	strreplace(cdev->name, '/', '_');
+	snprintf(cdev->nodename, sizeof(cdev->nodename), "mdio/%s", bus->id);
+	strreplace(cdev->nodename + strlen("mdio/"), '/', '_');
+
+	cdev->bus = bus;
+	cdev->misc.minor = MISC_DYNAMIC_MINOR;
+	cdev->misc.name = cdev->name;
+	cdev->misc.nodename = cdev->nodename;
+	cdev->misc.mode = 0600;
+	cdev->misc.fops = &mdio_nl_cdev_fops;
+
+	err = misc_register(&cdev->misc);
+	if (err) {
+		pr_warn("mdio-netlink: %s: no character device (%d)\n",
+			bus->id, err);
+		kfree(cdev);
+		return;
+	}
+
+	bus->cdev = cdev;
+}
+
+static void mdio_nl_cdev_del(struct mdio_nl_bus *bus)
+{
+	if (!bus->cdev)
+		return;
+
+	/* Files that are already open keep a reference to the bus
+	 * state, but transfers on them fail with ENODEV. */
+	misc_deregister(&bus->cdev->misc);
+	kfree(bus->cdev);
+	bus->cdev = NULL;
+}
+
+static void mdio_nl_bus_added(struct device *dev)
+{
+	struct mii_bus *mdio = to_mii_bus(dev);
+
+	mdio_nl_bus_add(mdio);
+	mdio_nl_notify(mdio, MDIO_GENL_NEW_BUS);
+}
+
+static void mdio_nl_bus_removed(struct device *dev)
+{
+	struct mii_bus *mdio = to_mii_bus(dev);
+
+	mdio_nl_notify(mdio, MDIO_GENL_DEL_BUS);
+	mdio_nl_bus_del(mdio);
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,4,0)
+static int mdio_nl_intf_add(struct device *dev, struct class_interface *intf)
+{
+	mdio_nl_bus_added(dev);
+	return 0;
+}
+
+static void mdio_nl_intf_remove(struct device *dev,
+				struct class_interface *intf)
+{
+	mdio_nl_bus_removed(dev);
+}
+#else
+static int mdio_nl_intf_add(struct device *dev)
+{
+	mdio_nl_bus_added(dev);
+	return 0;
+}
+
+static void mdio_nl_intf_remove(struct device *dev)
+{
+	mdio_nl_bus_removed(dev);
+}
+#endif
+
+static struct class_interface mdio_nl_intf = {
+	.add_dev    = mdio_nl_intf_add,
+	.remove_dev = mdio_nl_intf_remove,
+};
+
+static int __init mdio_nl_class_scan(struct device *dev, void *data)
+{
+	mdio_nl_class = (struct class *)to_mdio_device(dev)->bus->dev.class;
+	return 1;
+}
+
+static int mdio_nl_dummy_read(struct mii_bus *bus, int addr, int regnum)
+{
+	return -ENODEV;
+}
+
+static int mdio_nl_dummy_write(struct mii_bus *bus, int addr, int regnum,
+			       u16 val)
+{
+	return -ENODEV;
+}
+
+/* MDIO devices, unlike buses, live on an exported bus_type, so the
+ * class can usually be found through the bus of any one of them.
+ * Failing that, e.g. on systems where all PHYs are managed by a
+ * switch driver, learn it from a dummy bus. The dummy has all of its
+ * addresses masked off, so that it is never scanned, and no uevents
+ * are sent for it. */
+static int __init mdio_nl_class_find(void)
+{
+	struct mii_bus *dummy;
+	int err;
+
+	bus_for_each_dev(&mdio_bus_type, NULL, NULL, mdio_nl_class_scan);
+	if (mdio_nl_class)
+		return 0;
+
+	dummy = mdiobus_alloc();
+	if (!dummy)
+		return -ENOMEM;
+
+	dummy->name = "mdio-netlink";
+	strscpy(dummy->id, "mdio-netlink-probe", sizeof(dummy->id));
+	dummy->read = mdio_nl_dummy_read;
+	dummy->write = mdio_nl_dummy_write;
+	dummy->phy_mask = ~0;
+	dev_set_uevent_suppress(&dummy->dev, true);
+
+	err = mdiobus_register(dummy);
+	if (!err) {
+		mdio_nl_class = (struct class *)dummy->dev.class;
+		mdiobus_unregister(dummy);
+	}
+
+	mdiobus_free(dummy);
+	return err;
+}
+
+static const struct genl_ops mdio_nl_ops[] = {
+	{
+		.cmd = MDIO_GENL_XFER,
+		.doit = mdio_nl_cmd_xfer,
+		.flags = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd = MDIO_GENL_RATE,
+		.doit = mdio_nl_cmd_rate,
+		.flags = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd = MDIO_GENL_GET_BUSES,
+		.doit = mdio_nl_cmd_get_buses,
+		.dumpit = mdio_nl_dump_buses,
+	},
+	{
+		.cmd = MDIO_GENL_READ_LIST,
+		.doit = mdio_nl_cmd_list,
+		.flags = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd = MDIO_GENL_WRITE_LIST,
+		.doit = mdio_nl_cmd_list,
+		.flags = GENL_ADMIN_PERM,
+	},
+};
+
+static struct genl_family mdio_nl_family = {
 	.name     = "mdio",
 	.version  = 1,
 	.maxattr  = MDIO_NLA_MAX,
@@ -427,17 +2033,52 @@ static struct genl_family mdio_nl_family = {
 	.module   = THIS_MODULE,
 	.ops      = mdio_nl_ops,
 	.n_ops    = ARRAY_SIZE(mdio_nl_ops),
+	.mcgrps   = mdio_nl_mcgrps,
+	.n_mcgrps = ARRAY_SIZE(mdio_nl_mcgrps),
 	.policy   = mdio_nl_policy,
 };
 
 static int __init mdio_nl_init(void)
 {
-	return genl_register_family(&mdio_nl_family);
+	int err;
+
+	err = mdio_nl_class_find();
+	if (!err) {
+		mdio_nl_intf.class = mdio_nl_class;
+		err = class_interface_register(&mdio_nl_intf);
+		if (err)
+			mdio_nl_intf.class = NULL;
+	}
+
+	if (err)
+		pr_warn("mdio-netlink: bus enumeration unavailable (%d)\n",
+			err);
+
+	err = genl_register_family(&mdio_nl_family);
+	if (err)
+		goto err_intf;
+
+	WRITE_ONCE(mdio_nl_notify_enabled, true);
+	return 0;
+
+err_intf:
+	if (mdio_nl_intf.class)
+		class_interface_unregister(&mdio_nl_intf);
+
+	mdio_nl_bus_put_all();
+	return err;
 }
 
 static void __exit mdio_nl_exit(void)
 {
+	WRITE_ONCE(mdio_nl_notify_enabled, false);
+
 	genl_unregister_family(&mdio_nl_family);
+
+	if (mdio_nl_intf.class)
+		class_interface_unregister(&mdio_nl_intf);
+
+	mdio_nl_bus_put_all();
 }
 
 MODULE_AUTHOR("Tobias Waldekranz <tobias@waldekranz.com>");
@@ -0,0 +1,454 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/atomic.h>
+#include <linux/delay.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/mdio.h>
+#include <linux/module.h>
+#include <linux/phy.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/xarray.h>
+#include "compat.h"
+
+/* Simulated MDIO buses, to exercise mdio-netlink, and measure its
+ * overhead, without any real hardware. Each bus has the following
+ * devices on it:
+ *
+ * - A PHY at each address in present, with a sparse Clause 22 and
+ *   Clause 45 register file. Clause 45 registers are also reachable
+ *   via the MMD access registers (22.2.4.3.11).
+ *
+ * - Of those, the PHYs in paged use page_reg to select one of 256
+ *   pages, like Marvell Alaska or Microsemi PHYs.
+ *
+ * - A LinkStreet switch in multi-chip mode at each address in mvls,
+ *   with its internal registers reached via the SMI command and data
+ *   registers.
+ *
+ * Registers read as zero until they are written, except for the PHY
+ * identifier. Absent devices read as 0xffff. */
+
+#define MDIO_SIM_PHY_ID 0x01410dd0
+#define MDIO_SIM_MMD_FUNC_MASK 0xc000
+
+#define MDIO_SIM_SMI_BUSY	BIT(15)
+#define MDIO_SIM_SMI_C22	BIT(12)
+#define MDIO_SIM_SMI_OP_MASK	GENMASK(11, 10)
+#define MDIO_SIM_SMI_OP_WRITE	BIT(10)
+#define MDIO_SIM_SMI_OP_READ	BIT(11)
+
+static unsigned int mdio_sim_nbuses = 1;
+module_param_named(buses, mdio_sim_nbuses, uint, 0444);
+MODULE_PARM_DESC(buses, "Number of buses to register");
+
+static unsigned int mdio_sim_present = 0x000000ff;
+module_param_named(present, mdio_sim_present, uint, 0444);
+MODULE_PARM_DESC(present, "Mask of addresses with a PHY");
+
+static unsigned int mdio_sim_paged = 0x000000f0;
+module_param_named(paged, mdio_sim_paged, uint, 0444);
+MODULE_PARM_DESC(paged, "Mask of addresses with a paged PHY");
+
+static unsigned int mdio_sim_page_reg = 22;
+module_param_named(page_reg, mdio_sim_page_reg, uint, 0444);
+MODULE_PARM_DESC(page_reg, "Page register of paged PHYs");
+
+static unsigned int mdio_sim_mvls = 0x00010000;
+module_param_named(mvls, mdio_sim_mvls, uint, 0444);
+MODULE_PARM_DESC(mvls, "Mask of addresses with a multi-chip LinkStreet switch");
+
+static bool mdio_sim_c45 = true;
+module_param_named(c45, mdio_sim_c45, bool, 0444);
+MODULE_PARM_DESC(c45, "Support Clause 45 accesses natively");
+
+static unsigned int mdio_sim_latency_ns;
+module_param_named(latency_ns, mdio_sim_latency_ns, uint, 0644);
+MODULE_PARM_DESC(latency_ns, "Time that each access busy-waits for");
+
+static unsigned int mdio_sim_fail_every;
+module_param_named(fail_every, mdio_sim_fail_every, uint, 0644);
+MODULE_PARM_DESC(fail_every, "Fail every Nth access with EIO, 0 = never");
+
+struct mdio_sim_bus {
+	struct xarray regs;
+
+	/* Per address state of the MMD access registers */
+	u16 mmd_ctrl[PHY_MAX_ADDR];
+	u16 mmd_addr[PHY_MAX_ADDR];
+};
+
+static struct platform_device *mdio_sim_pdev;
+static struct mii_bus **mdio_sim_buses;
+static atomic_t mdio_sim_accesses;
+
+/* All register files share one sparse array, keyed on:
+ *
+ *   C22:  0 | addr:5 | page:8 | reg:5
+ *   C45:  1 | addr:5 | devad:5 | reg:16
+ *   mvls: 2 | addr:5 | dev:5 | reg:5
+ */
+static unsigned long mdio_sim_key_c22(int addr, u16 page, int reg)
+{
+	return (unsigned long)addr << 13 | page << 5 | reg;
+}
+
+static unsigned long mdio_sim_key_c45(int addr, int devad, u16 reg)
+{
+	return 1UL << 26 | (unsigned long)addr << 21 | devad << 16 | reg;
+}
+
+static unsigned long mdio_sim_key_mvls(int addr, int dev, int reg)
+{
+	return 2UL << 26 | (unsigned long)addr << 10 | dev << 5 | reg;
+}
+
+static u16 mdio_sim_get(struct mdio_sim_bus *sim, unsigned long key)
+{
+	void *entry = xa_load(&sim->regs, key);
+
+	return entry ? xa_to_value(entry) : 0;
+}
+
+static int mdio_sim_set(struct mdio_sim_bus *sim, unsigned long key, u16 val)
+{
+	return xa_err(xa_store(&sim->regs, key, xa_mk_value(val),
+			       GFP_KERNEL));
+}
+
+static int mdio_sim_access(void)
+{
+	unsigned int n = READ_ONCE(mdio_sim_fail_every);
+	unsigned int ns = READ_ONCE(mdio_sim_latency_ns);
+
+	/* Spin, like most MDIO controller drivers do */
+	if (ns)
+		ndelay(ns);
+
+	if (n && !(atomic_inc_return(&mdio_sim_accesses) % n))
+		return -EIO;
+
+	return 0;
+}
+
+static u16 mdio_sim_page(struct mdio_sim_bus *sim, int addr, int reg)
+{
+	unsigned long key = mdio_sim_key_c22(addr, 0, mdio_sim_page_reg);
+
+	if (!(mdio_sim_paged & BIT(addr)) || reg == mdio_sim_page_reg)
+		return 0;
+
+	return mdio_sim_get(sim, key) & 0xff;
+}
+
+static int mdio_sim_read_c45(struct mii_bus *bus, int addr, int devad,
+			     int reg)
+{
+	struct mdio_sim_bus *sim = bus->priv;
+	int err;
+
+	err = mdio_sim_access();
+	if (err)
+		return err;
+
+	if (!(mdio_sim_present & BIT(addr)))
+		return 0xffff;
+
+	return mdio_sim_get(sim, mdio_sim_key_c45(addr, devad, reg));
+}
+
+static int mdio_sim_write_c45(struct mii_bus *bus, int addr, int devad,
+			      int reg, u16 val)
+{
+	struct mdio_sim_bus *sim = bus->priv;
+	int err;
+
+	err = mdio_sim_access();
+	if (err)
+		return err;
+
+	if (!(mdio_sim_present & BIT(addr)))
+		return 0;
+
+	return mdio_sim_set(sim, mdio_sim_key_c45(addr, devad, reg), val);
+}
+
+/* Clause 45 access via Clause 22 registers 13 and 14 */
+static int mdio_sim_mmd(struct mdio_sim_bus *sim, int addr, u16 *val,
+			bool write)
+{
+	u16 ctrl = sim->mmd_ctrl[addr];
+	unsigned long key;
+	int err = 0;
+
+	if (!(ctrl & MDIO_SIM_MMD_FUNC_MASK)) {
+		if (write)
+			sim->mmd_addr[addr] = *val;
+		else
+			*val = sim->mmd_addr[addr];
+
+		return 0;
+	}
+
+	key = mdio_sim_key_c45(addr, ctrl & MII_MMD_CTRL_DEVAD_MASK,
+			       sim->mmd_addr[addr]);
+	if (write)
+		err = mdio_sim_set(sim, key, *val);
+	else
+		*val = mdio_sim_get(sim, key);
+
+	switch (ctrl & MDIO_SIM_MMD_FUNC_MASK) {
+	case MII_MMD_CTRL_INCR_RDWT:
+		sim->mmd_addr[addr]++;
+		break;
+	case MII_MMD_CTRL_INCR_ON_WT:
+		if (write)
+			sim->mmd_addr[addr]++;
+		break;
+	}
+
+	return err;
+}
+
+static int mdio_sim_mvls_cmd(struct mdio_sim_bus *sim, int addr, u16 cmd)
+{
+	unsigned long key = mdio_sim_key_mvls(addr, (cmd >> 5) & 0x1f,
+					      cmd & 0x1f);
+	unsigned long data = mdio_sim_key_c22(addr, 0, 1);
+
+	if (!(cmd & MDIO_SIM_SMI_BUSY) || !(cmd & MDIO_SIM_SMI_C22))
+		return 0;
+
+	switch (cmd & MDIO_SIM_SMI_OP_MASK) {
+	case MDIO_SIM_SMI_OP_WRITE:
+		return mdio_sim_set(sim, key, mdio_sim_get(sim, data));
+	case MDIO_SIM_SMI_OP_READ:
+		return mdio_sim_set(sim, data, mdio_sim_get(sim, key));
+	}
+
+	return 0;
+}
+
+static int mdio_sim_read_c22(struct mii_bus *bus, int addr, int reg)
+{
+	struct mdio_sim_bus *sim = bus->priv;
+	u16 val;
+	int err;
+
+	err = mdio_sim_access();
+	if (err)
+		return err;
+
+	if (mdio_sim_mvls & BIT(addr)) {
+		/* Only the command and data registers exist */
+		if (reg > 1)
+			return 0xffff;
+
+		return mdio_sim_get(sim, mdio_sim_key_c22(addr, 0, reg));
+	}
+
+	if (!(mdio_sim_present & BIT(addr)))
+		return 0xffff;
+
+	switch (reg) {
+	case MII_PHYSID1:
+		return MDIO_SIM_PHY_ID >> 16;
+	case MII_PHYSID2:
+		return MDIO_SIM_PHY_ID & 0xffff;
+	case MII_MMD_CTRL:
+		return sim->mmd_ctrl[addr];
+	case MII_MMD_DATA:
+		err = mdio_sim_mmd(sim, addr, &val, false);
+		return err ? : val;
+	}
+
+	return mdio_sim_get(sim, mdio_sim_key_c22(addr,
+						  mdio_sim_page(sim, addr, reg),
+						  reg));
+}
+
+static int mdio_sim_write_c22(struct mii_bus *bus, int addr, int reg,
+			      u16 val)
+{
+	struct mdio_sim_bus *sim = bus->priv;
+	int err;
+
+	err = mdio_sim_access();
+	if (err)
+		return err;
+
+	if (mdio_sim_mvls & BIT(addr)) {
+		if (reg > 1)
+			return 0;
+
+		if (reg)
+			return mdio_sim_set(sim, mdio_sim_key_c22(addr, 0, 1), val);
+
+		/* Operations complete immediately, so busy is never seen */
+		err = mdio_sim_mvls_cmd(sim, addr, val);
+		if (err)
+			return err;
+
+		return mdio_sim_set(sim, mdio_sim_key_c22(addr, 0, 0),
+				    val & ~MDIO_SIM_SMI_BUSY);
+	}
+
+	if (!(mdio_sim_present & BIT(addr)))
+		return 0;
+
+	switch (reg) {
+	case MII_PHYSID1:
+	case MII_PHYSID2:
+		return 0;
+	case MII_MMD_CTRL:
+		sim->mmd_ctrl[addr] = val;
+		return 0;
+	case MII_MMD_DATA:
+		return mdio_sim_mmd(sim, addr, &val, true);
+	}
+
+	return mdio_sim_set(sim, mdio_sim_key_c22(addr,
+						  mdio_sim_page(sim, addr, reg),
+						  reg), val);
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,3,0)
+static int mdio_sim_read(struct mii_bus *bus, int addr, int regnum)
+{
+	if (!(regnum & MII_ADDR_C45))
+		return mdio_sim_read_c22(bus, addr, regnum);
+
+	if (!mdio_sim_c45)
+		return -EOPNOTSUPP;
+
+	return mdio_sim_read_c45(bus, addr, (regnum >> 16) & 0x1f,
+				 regnum & 0xffff);
+}
+
+static int mdio_sim_write(struct mii_bus *bus, int addr, int regnum, u16 val)
+{
+	if (!(regnum & MII_ADDR_C45))
+		return mdio_sim_write_c22(bus, addr, regnum, val);
+
+	if (!mdio_sim_c45)
+		return -EOPNOTSUPP;
+
+	return mdio_sim_write_c45(bus, addr, (regnum >> 16) & 0x1f,
+				  regnum & 0xffff, val);
+}
+
+static void mdio_sim_ops(struct mii_bus *bus)
+{
+	bus->read = mdio_sim_read;
+	bus->write = mdio_sim_write;
+}
+#else
+static void mdio_sim_ops(struct mii_bus *bus)
+{
+	bus->read = mdio_sim_read_c22;
+	bus->write = mdio_sim_write_c22;
+
+	if (mdio_sim_c45) {
+		bus->read_c45 = mdio_sim_read_c45;
+		bus->write_c45 = mdio_sim_write_c45;
+	}
+}
+#endif
+
+static struct mii_bus *mdio_sim_bus_create(unsigned int index)
+{
+	struct mdio_sim_bus *sim;
+	struct mii_bus *bus;
+	int err;
+
+	bus = mdiobus_alloc_size(sizeof(*sim));
+	if (!bus)
+		return ERR_PTR(-ENOMEM);
+
+	sim = bus->priv;
+	xa_init(&sim->regs);
+
+	bus->name = "mdio-sim";
+	snprintf(bus->id, MII_BUS_ID_SIZE, "sim-%u", index);
+	bus->parent = &mdio_sim_pdev->dev;
+	mdio_sim_ops(bus);
+
+	/* Keep phylib from probing, and then poking at, our PHYs */
+	bus->phy_mask = ~0;
+
+	err = mdiobus_register(bus);
+	if (err) {
+		xa_destroy(&sim->regs);
+		mdiobus_free(bus);
+		return ERR_PTR(err);
+	}
+
+	return bus;
+}
+
+static void mdio_sim_bus_destroy(struct mii_bus *bus)
+{
+	struct mdio_sim_bus *sim = bus->priv;
+
+	mdiobus_unregister(bus);
+	xa_destroy(&sim->regs);
+	mdiobus_free(bus);
+}
+
+static void mdio_sim_destroy(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < mdio_sim_nbuses && mdio_sim_buses[i]; i++)
+		mdio_sim_bus_destroy(mdio_sim_buses[i]);
+
+	kfree(mdio_sim_buses);
+	platform_device_unregister(mdio_sim_pdev);
+}
+
+static int __init mdio_sim_init(void)
+{
+	struct mii_bus *bus;
+	unsigned int i;
+
+	if (mdio_sim_page_reg >= 32 || mdio_sim_page_reg == MII_MMD_CTRL ||
+	    mdio_sim_page_reg == MII_MMD_DATA)
+		return -EINVAL;
+
+	mdio_sim_pdev = platform_device_register_simple("mdio-sim", -1,
+							NULL, 0);
+	if (IS_ERR(mdio_sim_pdev))
+		return PTR_ERR(mdio_sim_pdev);
+
+	mdio_sim_buses = kcalloc(mdio_sim_nbuses, sizeof(*mdio_sim_buses),
+				 GFP_KERNEL);
+	if (!mdio_sim_buses) {
+		platform_device_unregister(mdio_sim_pdev);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < mdio_sim_nbuses; i++) {
+		bus = mdio_sim_bus_create(i);
+		if (IS_ERR(bus)) {
+			mdio_sim_destroy();
+			return PTR_ERR(bus);
+		}
+
+		mdio_sim_buses[i] = bus;
+	}
+
+	return 0;
+}
+
+static void __exit mdio_sim_exit(void)
+{
+	mdio_sim_destroy();
+}
+
+module_init(mdio_sim_init);
+module_exit(mdio_sim_exit);
+
+MODULE_AUTHOR("Tobias Waldekranz <tobias@waldekranz.com>");
+MODULE_DESCRIPTION("Simulated MDIO Buses");
+MODULE_LICENSE("GPL");
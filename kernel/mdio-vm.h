@@ -0,0 +1,651 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#ifndef _MDIO_VM_H_
+#define _MDIO_VM_H_
+
+/* Core of the mdio-netlink VM: validation and evaluation of
+ * programs. It builds both as part of the module, and in userspace,
+ * where the simulator and micro-benchmarks in src/ use it.
+ *
+ * Everything that touches the outside world is left to the includer,
+ * which must define the mdio_vm_*() hooks declared below. They are
+ * static, so that they can be inlined into mdio_vm_eval().
+ */
+
+#ifdef __KERNEL__
+#include <linux/bits.h>
+#include <linux/bug.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/mdio.h>
+#include <linux/mdio-netlink.h>
+#include <linux/time64.h>
+#include <linux/types.h>
+#else
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <linux/mdio.h>
+#include <linux/mdio-netlink.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef int16_t  s16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#ifndef BIT
+#define BIT(_n) (1 << (_n))
+#endif
+
+#define BUG()      abort()
+#define BUG_ON(_c) do { if (_c) abort(); } while (0)
+
+#define U32_MAX       UINT32_MAX
+#define NSEC_PER_USEC 1000ULL
+
+static inline bool mdio_phy_id_is_c45(int phy_id)
+{
+	return (phy_id & MDIO_PHY_ID_C45) && !(phy_id & ~MDIO_PHY_ID_C45_MASK);
+}
+
+static inline u16 mdio_phy_id_prtad(int phy_id)
+{
+	return (phy_id & MDIO_PHY_ID_PRTAD) >> 5;
+}
+
+static inline u16 mdio_phy_id_devad(int phy_id)
+{
+	return phy_id & MDIO_PHY_ID_DEVAD;
+}
+#endif
+
+struct mdio_vm {
+	const struct mdio_nl_insn *prog;
+	u32 prog_len;
+
+	u32 flags;		/* MDIO_NL_F_* */
+	u32 timeout_us;
+
+	/* Where to start, and, if the program times out, where it
+	 * stopped. */
+	struct mdio_nl_state state;
+	bool stopped;
+
+	/* Number of instructions executed */
+	u32 insns;
+};
+
+/* Bus access. Clause 45 addresses are to be accessed natively if
+ * possible, otherwise indirectly via Clause 22. */
+static int mdio_vm_read(struct mdio_vm *vm, u16 dev, u16 reg);
+static int mdio_vm_write(struct mdio_vm *vm, u16 dev, u16 reg, u16 val);
+static int mdio_vm_mmd_read(struct mdio_vm *vm, u16 dev, u16 reg);
+static int mdio_vm_mmd_write(struct mdio_vm *vm, u16 dev, u16 reg, u16 val);
+
+static int mdio_vm_emit(struct mdio_vm *vm, u32 datum);
+
+/* Called before each instruction executed without the bus lock
+ * held. A non-zero return aborts the program with that error. */
+static int mdio_vm_yield(struct mdio_vm *vm);
+static void mdio_vm_lock(struct mdio_vm *vm);
+static void mdio_vm_unlock(struct mdio_vm *vm);
+
+/* Nanoseconds, from an arbitrary starting point */
+static u64 mdio_vm_now(struct mdio_vm *vm);
+static void mdio_vm_delay(struct mdio_vm *vm, u16 us);
+
+struct mdio_vm_proto {
+	u8 arg0;
+	u8 arg1;
+	u8 arg2;
+};
+
+static const struct mdio_vm_proto mdio_vm_protos[MDIO_NL_OP_MAX + 1] = {
+	[MDIO_NL_OP_READ] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_REG),
+	},
+	[MDIO_NL_OP_WRITE] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+	},
+	[MDIO_NL_OP_AND] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_REG),
+	},
+	[MDIO_NL_OP_OR] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_REG),
+	},
+	[MDIO_NL_OP_ADD] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_REG),
+	},
+	[MDIO_NL_OP_JEQ] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_IMM),
+	},
+	[MDIO_NL_OP_JNE] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_IMM),
+	},
+	[MDIO_NL_OP_EMIT] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_NONE),
+		.arg2 = BIT(MDIO_NL_ARG_NONE),
+	},
+	[MDIO_NL_OP_LOCK] = {
+		.arg0 = BIT(MDIO_NL_ARG_NONE),
+		.arg1 = BIT(MDIO_NL_ARG_NONE),
+		.arg2 = BIT(MDIO_NL_ARG_NONE),
+	},
+	[MDIO_NL_OP_UNLOCK] = {
+		.arg0 = BIT(MDIO_NL_ARG_NONE),
+		.arg1 = BIT(MDIO_NL_ARG_NONE),
+		.arg2 = BIT(MDIO_NL_ARG_NONE),
+	},
+	[MDIO_NL_OP_PAGE] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+	},
+	[MDIO_NL_OP_MMD_READ] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_REG),
+	},
+	[MDIO_NL_OP_MMD_WRITE] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg2 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+	},
+	[MDIO_NL_OP_DELAY] = {
+		.arg0 = BIT(MDIO_NL_ARG_REG) | BIT(MDIO_NL_ARG_IMM),
+		.arg1 = BIT(MDIO_NL_ARG_NONE),
+		.arg2 = BIT(MDIO_NL_ARG_NONE),
+	},
+	[MDIO_NL_OP_TIMESTAMP] = {
+		.arg0 = BIT(MDIO_NL_ARG_NONE),
+		.arg1 = BIT(MDIO_NL_ARG_NONE),
+		.arg2 = BIT(MDIO_NL_ARG_NONE),
+	},
+};
+
+enum mdio_vm_fault {
+	MDIO_VM_OK,
+	MDIO_VM_ILLEGAL,
+	MDIO_VM_ARG0,
+	MDIO_VM_ARG1,
+	MDIO_VM_ARG2,
+};
+
+static inline enum mdio_vm_fault
+mdio_vm_check_insn(const struct mdio_nl_insn *insn)
+{
+	const struct mdio_vm_proto *proto;
+
+	if (insn->op > MDIO_NL_OP_MAX)
+		return MDIO_VM_ILLEGAL;
+
+	proto = &mdio_vm_protos[insn->op];
+
+	if (!(BIT(insn->arg0 >> 16) & proto->arg0))
+		return MDIO_VM_ARG0;
+
+	if (!(BIT(insn->arg1 >> 16) & proto->arg1))
+		return MDIO_VM_ARG1;
+
+	if (!(BIT(insn->arg2 >> 16) & proto->arg2))
+		return MDIO_VM_ARG2;
+
+	return MDIO_VM_OK;
+}
+
+static inline u16 *__arg_r(u32 arg, u16 *regs)
+{
+	BUG_ON(arg >> 16 != MDIO_NL_ARG_REG);
+
+	return &regs[arg & 0x7];
+}
+
+static inline u16 __arg_i(u32 arg)
+{
+	BUG_ON(arg >> 16 != MDIO_NL_ARG_IMM);
+
+	return arg & 0xffff;
+}
+
+static inline u16 __arg_ri(u32 arg, u16 *regs)
+{
+	switch ((enum mdio_nl_argmode)(arg >> 16)) {
+	case MDIO_NL_ARG_IMM:
+		return arg & 0xffff;
+	case MDIO_NL_ARG_REG:
+		return regs[arg & 7];
+	default:
+		BUG();
+	}
+}
+
+/* In non-fatal mode, each register carries the error, if any, of the
+ * read that produced its value. Errors propagate through arithmetic,
+ * and are reported along with the value when it is emitted. */
+static inline u16 __arg_err(u32 arg, const u16 *errs)
+{
+	if (arg >> 16 != MDIO_NL_ARG_REG)
+		return 0;
+
+	return errs[arg & 0x7];
+}
+
+static inline int mdio_vm_load(struct mdio_vm *vm, u32 dst, u16 *regs,
+			       u16 *errs, int ret)
+{
+	if (ret < 0) {
+		if (!(vm->flags & MDIO_NL_F_NONFATAL))
+			return ret;
+
+		/* Same value as is typically read from an absent
+		 * device, so that programs can branch on it. */
+		*__arg_r(dst, regs) = 0xffff;
+		errs[dst & 0x7] = -ret;
+		return 0;
+	}
+
+	*__arg_r(dst, regs) = ret;
+	errs[dst & 0x7] = 0;
+	return 0;
+}
+
+static inline u32 mdio_vm_datum(u16 val, u16 err)
+{
+	if (!err)
+		return val;
+
+	return MDIO_NL_DATA_ERR | ((u32)err << 16) | val;
+}
+
+static inline bool mdio_vm_is_sectioned(struct mdio_vm *vm)
+{
+	u32 i;
+
+	for (i = 0; i < vm->prog_len; i++) {
+		switch (vm->prog[i].op) {
+		case MDIO_NL_OP_LOCK:
+		case MDIO_NL_OP_UNLOCK:
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Instructions that must run with the bus lock held. LOCK is included
+ * since it opens a section. */
+static inline bool mdio_vm_needs_lock(const struct mdio_nl_insn *insn)
+{
+	switch (insn->op) {
+	case MDIO_NL_OP_READ:
+	case MDIO_NL_OP_WRITE:
+	case MDIO_NL_OP_MMD_READ:
+	case MDIO_NL_OP_MMD_WRITE:
+	case MDIO_NL_OP_PAGE:
+	case MDIO_NL_OP_LOCK:
+		return true;
+	}
+
+	return false;
+}
+
+/* Tracks the page register of the device targeted by the most recent
+ * PAGE instruction, so that the page is only written when it actually
+ * changes, and can be restored before the bus lock is released. */
+struct mdio_vm_page {
+	bool valid;
+	u16 dev;
+	u16 preg;
+	u16 orig;
+	u16 cur;
+};
+
+static inline int mdio_vm_page_restore(struct mdio_vm *vm,
+				       struct mdio_vm_page *page)
+{
+	int err = 0;
+
+	if (page->valid && page->cur != page->orig)
+		err = mdio_vm_write(vm, page->dev, page->preg, page->orig);
+
+	page->valid = false;
+	return err;
+}
+
+static inline int mdio_vm_page_select(struct mdio_vm *vm,
+				      struct mdio_vm_page *page,
+				      u16 dev, u16 preg, u16 val)
+{
+	int err;
+
+	if (page->valid && (page->dev != dev || page->preg != preg)) {
+		err = mdio_vm_page_restore(vm, page);
+		if (err)
+			return err;
+	}
+
+	if (!page->valid) {
+		err = mdio_vm_read(vm, dev, preg);
+		if (err < 0)
+			return err;
+
+		*page = (struct mdio_vm_page) {
+			.valid = true,
+			.dev = dev,
+			.preg = preg,
+			.orig = err,
+			.cur = err,
+		};
+	}
+
+	if (page->cur == val)
+		return 0;
+
+	err = mdio_vm_write(vm, dev, preg, val);
+	if (err)
+		return err;
+
+	page->cur = val;
+	return 0;
+}
+
+/* Checks a state passed in by the caller to resume from, except for
+ * the program counter, which the caller checks against its program.
+ * Errors are only carried in non-fatal mode, and never in the range
+ * that the kernel reserves for itself (ERESTARTSYS and up). */
+static inline bool mdio_vm_state_valid(const struct mdio_vm *vm)
+{
+	const struct mdio_nl_state *state = &vm->state;
+	int i;
+
+	if (state->flags & ~MDIO_NL_STATE_F_MASK || state->reserved)
+		return false;
+
+	for (i = 0; i < 8; i++) {
+		if (!state->errs[i])
+			continue;
+
+		if (!(vm->flags & MDIO_NL_F_NONFATAL) || state->errs[i] >= 512)
+			return false;
+	}
+
+	return true;
+}
+
+/* Record where to resume from. The bus lock is released before the
+ * caller gets to resume, which would break up a section, so
+ * timeouts inside of one are final. */
+static inline int mdio_vm_stop(struct mdio_vm *vm, u32 pc, bool section,
+			       const struct mdio_vm_page *page)
+{
+	if (section)
+		return -ETIMEDOUT;
+
+	vm->state.pc = pc;
+	vm->state.flags = 0;
+
+	/* The page is restored when the lock is released, reselect it
+	 * when resuming. */
+	if (page->valid) {
+		vm->state.flags |= MDIO_NL_STATE_F_PAGE;
+		vm->state.page_dev = page->dev;
+		vm->state.page_reg = page->preg;
+		vm->state.page = page->cur;
+	}
+
+	vm->stopped = true;
+	return -ETIMEDOUT;
+}
+
+static inline int mdio_vm_eval(struct mdio_vm *vm)
+{
+	bool sectioned, section = false, held = false, repage;
+	struct mdio_vm_page page = { .valid = false };
+	const struct mdio_nl_insn *insn;
+	u64 deadline, stamp, now;
+	u16 *regs = vm->state.regs;
+	u16 *errs = vm->state.errs;
+	u16 dev, reg, val;
+	u32 pc;
+	int err, ret = 0;
+
+	stamp = mdio_vm_now(vm);
+	deadline = stamp + (u64)vm->timeout_us * NSEC_PER_USEC;
+
+	/* Programs without any LOCK/UNLOCK instructions are executed
+	 * as one atomic unit. Sectioned programs only hold the bus
+	 * lock inside of LOCK/UNLOCK pairs, and for the duration of
+	 * single bus accesses outside of them. */
+	sectioned = mdio_vm_is_sectioned(vm);
+	repage = vm->state.flags & MDIO_NL_STATE_F_PAGE;
+
+	for (pc = vm->state.pc, insn = &vm->prog[pc];
+	     pc < vm->prog_len;
+	     insn = &vm->prog[++pc]) {
+		if (mdio_vm_now(vm) > deadline) {
+			/* Nothing has been done by the current
+			 * instruction yet, so the caller can pick up
+			 * from here. */
+			ret = mdio_vm_stop(vm, pc, section, &page);
+			break;
+		}
+
+		if (!held) {
+			ret = mdio_vm_yield(vm);
+			if (ret)
+				break;
+
+			if (!sectioned || mdio_vm_needs_lock(insn)) {
+				mdio_vm_lock(vm);
+				held = true;
+			}
+		}
+
+		if (held && repage) {
+			repage = false;
+			ret = mdio_vm_page_select(vm, &page,
+						  vm->state.page_dev,
+						  vm->state.page_reg,
+						  vm->state.page);
+			if (ret < 0)
+				goto exit;
+		}
+
+		vm->insns++;
+
+		switch ((enum mdio_nl_op)insn->op) {
+		case MDIO_NL_OP_READ:
+			dev = __arg_ri(insn->arg0, regs);
+			reg = __arg_ri(insn->arg1, regs);
+
+			ret = mdio_vm_read(vm, dev, reg);
+			ret = mdio_vm_load(vm, insn->arg2, regs, errs, ret);
+			if (ret < 0)
+				goto exit;
+			break;
+
+		case MDIO_NL_OP_WRITE:
+			dev = __arg_ri(insn->arg0, regs);
+			reg = __arg_ri(insn->arg1, regs);
+			val = __arg_ri(insn->arg2, regs);
+
+			/* Never write values derived from failed reads */
+			ret = -__arg_err(insn->arg2, errs);
+			if (ret < 0)
+				goto exit;
+
+			ret = mdio_vm_write(vm, dev, reg, val);
+			if (ret < 0)
+				goto exit;
+			ret = 0;
+			break;
+
+		case MDIO_NL_OP_AND:
+			*__arg_r(insn->arg2, regs) =
+				__arg_ri(insn->arg0, regs) &
+				__arg_ri(insn->arg1, regs);
+			errs[insn->arg2 & 0x7] = __arg_err(insn->arg0, errs) ? :
+				__arg_err(insn->arg1, errs);
+			break;
+
+		case MDIO_NL_OP_OR:
+			*__arg_r(insn->arg2, regs) =
+				__arg_ri(insn->arg0, regs) |
+				__arg_ri(insn->arg1, regs);
+			errs[insn->arg2 & 0x7] = __arg_err(insn->arg0, errs) ? :
+				__arg_err(insn->arg1, errs);
+			break;
+
+		case MDIO_NL_OP_ADD:
+			*__arg_r(insn->arg2, regs) =
+				__arg_ri(insn->arg0, regs) +
+				__arg_ri(insn->arg1, regs);
+			errs[insn->arg2 & 0x7] = __arg_err(insn->arg0, errs) ? :
+				__arg_err(insn->arg1, errs);
+			break;
+
+		case MDIO_NL_OP_JEQ:
+			if (__arg_ri(insn->arg0, regs) ==
+			    __arg_ri(insn->arg1, regs))
+				pc += (s16)__arg_i(insn->arg2);
+			break;
+
+		case MDIO_NL_OP_JNE:
+			if (__arg_ri(insn->arg0, regs) !=
+			    __arg_ri(insn->arg1, regs))
+				pc += (s16)__arg_i(insn->arg2);
+			break;
+
+		case MDIO_NL_OP_EMIT:
+			ret = mdio_vm_emit(vm,
+					   mdio_vm_datum(__arg_ri(insn->arg0, regs),
+							 __arg_err(insn->arg0, errs)));
+			if (ret < 0)
+				goto exit;
+			ret = 0;
+			break;
+
+		case MDIO_NL_OP_LOCK:
+			if (section) {
+				ret = -EDEADLK;
+				goto exit;
+			}
+
+			section = true;
+			break;
+
+		case MDIO_NL_OP_UNLOCK:
+			if (!section) {
+				ret = -EPERM;
+				goto exit;
+			}
+
+			section = false;
+			break;
+
+		case MDIO_NL_OP_MMD_READ:
+			dev = __arg_ri(insn->arg0, regs);
+			reg = __arg_ri(insn->arg1, regs);
+			if (!mdio_phy_id_is_c45(dev)) {
+				ret = -EINVAL;
+				goto exit;
+			}
+
+			ret = mdio_vm_mmd_read(vm, dev, reg);
+			ret = mdio_vm_load(vm, insn->arg2, regs, errs, ret);
+			if (ret < 0)
+				goto exit;
+			break;
+
+		case MDIO_NL_OP_MMD_WRITE:
+			dev = __arg_ri(insn->arg0, regs);
+			reg = __arg_ri(insn->arg1, regs);
+			val = __arg_ri(insn->arg2, regs);
+			if (!mdio_phy_id_is_c45(dev)) {
+				ret = -EINVAL;
+				goto exit;
+			}
+
+			ret = -__arg_err(insn->arg2, errs);
+			if (ret < 0)
+				goto exit;
+
+			ret = mdio_vm_mmd_write(vm, dev, reg, val);
+			if (ret < 0)
+				goto exit;
+			ret = 0;
+			break;
+
+		case MDIO_NL_OP_DELAY:
+			val = __arg_ri(insn->arg0, regs);
+			if (mdio_vm_now(vm) + val * NSEC_PER_USEC > deadline) {
+				ret = mdio_vm_stop(vm, pc, section, &page);
+				goto exit;
+			}
+
+			mdio_vm_delay(vm, val);
+			break;
+
+		case MDIO_NL_OP_TIMESTAMP:
+			now = mdio_vm_now(vm);
+			ret = mdio_vm_emit(vm, now - stamp > U32_MAX ?
+					   U32_MAX : now - stamp);
+			if (ret < 0)
+				goto exit;
+			stamp = now;
+			break;
+
+		case MDIO_NL_OP_PAGE:
+			ret = mdio_vm_page_select(vm, &page,
+						  __arg_ri(insn->arg0, regs),
+						  __arg_ri(insn->arg1, regs),
+						  __arg_ri(insn->arg2, regs));
+			if (ret < 0)
+				goto exit;
+			break;
+
+		case MDIO_NL_OP_UNSPEC:
+		default:
+			ret = -EINVAL;
+			goto exit;
+		}
+
+		if (held && sectioned && !section) {
+			ret = mdio_vm_page_restore(vm, &page);
+			mdio_vm_unlock(vm);
+			held = false;
+			if (ret < 0)
+				break;
+		}
+	}
+exit:
+	if (held) {
+		/* Never leave a device on a different page than the
+		 * one we found it on, even if the program failed. */
+		err = mdio_vm_page_restore(vm, &page);
+		mdio_vm_unlock(vm);
+		if (!ret)
+			ret = err;
+	}
+
+	return ret;
+}
+
+#endif	/* _MDIO_VM_H_ */
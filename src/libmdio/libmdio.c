@@ -0,0 +1,828 @@
+#include <errno.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libmnl/libmnl.h>
+#include <linux/genetlink.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "libmdio.h"
+
+#define BIT(_n) (1 << (_n))
+
+/* Size of the buffer used for each request and its replies */
+#define MDIO_MSG_SIZE 0x1000
+
+#define MDIO_MSG_BUF(_name) \
+	char _name[MDIO_MSG_SIZE] __attribute__ ((aligned (NLMSG_ALIGNTO)))
+
+struct mdio_ctx {
+	uint16_t family;
+	uint32_t mcgrp_bus;
+
+	/* Protects the caches below. Everything else is read-only
+	 * once the context is created. */
+	pthread_mutex_t lock;
+
+	/* Handle of the most recently resolved bus, letting the kernel
+	 * skip the by-name lookup on subsequent requests. */
+	struct {
+		char id[64];
+		uint32_t handle;
+	} bus_cache;
+
+	/* Last answer from mdio_ctx_bus_info() */
+	struct mdio_bus_info info_cache;
+};
+
+int mdio_prog_push(struct mdio_prog *prog, struct mdio_nl_insn insn)
+{
+	struct mdio_nl_insn *insns;
+
+	insns = realloc(prog->insns, (prog->len + 1) * sizeof(insn));
+	if (!insns)
+		return -ENOMEM;
+
+	prog->insns = insns;
+	prog->insns[prog->len++] = insn;
+	return 0;
+}
+
+void mdio_prog_free(struct mdio_prog *prog)
+{
+	free(prog->insns);
+	prog->insns = NULL;
+	prog->len = 0;
+}
+
+static int parse_attrs(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	tb[type] = attr;
+
+	return MNL_CB_OK;
+}
+
+static struct mnl_socket *msg_send(int bus, struct nlmsghdr *nlh)
+{
+	struct mnl_socket *nl;
+	int err;
+
+	nl = mnl_socket_open(bus);
+	if (nl == NULL)
+		return NULL;
+
+	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0 ||
+	    mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
+		err = errno;
+		mnl_socket_close(nl);
+		errno = err;
+		return NULL;
+	}
+
+	return nl;
+}
+
+static int msg_recv(struct mnl_socket *nl, char *buf, mnl_cb_t callback,
+		    void *data, int seq)
+{
+	unsigned int portid;
+	int ret;
+
+	portid = mnl_socket_get_portid(nl);
+
+	ret = mnl_socket_recvfrom(nl, buf, MDIO_MSG_SIZE);
+	while (ret > 0) {
+		ret = mnl_cb_run(buf, ret, seq, portid, callback, data);
+		if (ret <= 0)
+			break;
+		ret = mnl_socket_recvfrom(nl, buf, MDIO_MSG_SIZE);
+	}
+
+	return ret;
+}
+
+/* Replies are received into a buffer of their own, leaving the
+ * request intact so that it can be sent again. */
+static int msg_query(struct nlmsghdr *nlh, mnl_cb_t callback, void *data)
+{
+	unsigned int seq;
+	struct mnl_socket *nl;
+	MDIO_MSG_BUF(buf);
+	int ret;
+
+	seq = time(NULL);
+	nlh->nlmsg_seq = seq;
+
+	nl = msg_send(NETLINK_GENERIC, nlh);
+	if (!nl)
+		return -errno;
+
+	/* Callbacks that bail out do not set errno, netlink errors
+	 * from the kernel do. */
+	errno = 0;
+	ret = msg_recv(nl, buf, callback, data, seq);
+	if (ret < 0)
+		ret = errno ? -errno : -EIO;
+
+	mnl_socket_close(nl);
+	return ret;
+}
+
+static struct nlmsghdr *msg_init(struct mdio_ctx *ctx, char *buf,
+				 int cmd, int flags)
+{
+	struct genlmsghdr *genl;
+	struct nlmsghdr *nlh;
+
+	nlh = mnl_nlmsg_put_header(buf);
+	if (!nlh)
+		return NULL;
+
+	nlh->nlmsg_type	 = ctx->family;
+	nlh->nlmsg_flags = flags;
+
+	genl = mnl_nlmsg_put_extra_header(nlh, sizeof(struct genlmsghdr));
+	genl->cmd = cmd;
+	genl->version = 1;
+
+	return nlh;
+}
+
+static void mdio_bus_cache_set(struct mdio_ctx *ctx, const char *bus,
+			       uint32_t handle)
+{
+	if (!handle)
+		return;
+
+	pthread_mutex_lock(&ctx->lock);
+	snprintf(ctx->bus_cache.id, sizeof(ctx->bus_cache.id), "%s", bus);
+	ctx->bus_cache.handle = handle;
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static void mdio_bus_cache_drop(struct mdio_ctx *ctx, uint32_t handle)
+{
+	pthread_mutex_lock(&ctx->lock);
+	if (ctx->bus_cache.handle == handle)
+		memset(&ctx->bus_cache, 0, sizeof(ctx->bus_cache));
+
+	if (ctx->info_cache.handle == handle)
+		memset(&ctx->info_cache, 0, sizeof(ctx->info_cache));
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+/* Address the request to the bus, using its cached handle if there
+ * is one, and send it. The bus attribute is added last, so that it
+ * can be replaced if the request has to be resent. */
+static int msg_query_bus(struct mdio_ctx *ctx, struct nlmsghdr *nlh,
+			 const char *bus, mnl_cb_t callback, void *data)
+{
+	uint32_t len = nlh->nlmsg_len;
+	uint32_t handle = 0;
+	int err;
+
+	pthread_mutex_lock(&ctx->lock);
+	if (!strcmp(ctx->bus_cache.id, bus))
+		handle = ctx->bus_cache.handle;
+	pthread_mutex_unlock(&ctx->lock);
+
+	if (handle) {
+		if (!mnl_attr_put_u32_check(nlh, MDIO_MSG_SIZE,
+					    MDIO_NLA_BUS_HANDLE, handle))
+			return -EMSGSIZE;
+
+		err = msg_query(nlh, callback, data);
+		if (err != -ENODEV)
+			return err;
+
+		/* The bus has gone away since its handle was cached,
+		 * but may have been replaced by a new one by the same
+		 * name. The kernel rejects stale handles before doing
+		 * anything else, so it is safe to try again by name. */
+		mdio_bus_cache_drop(ctx, handle);
+		nlh->nlmsg_len = len;
+	}
+
+	if (!mnl_attr_put_strz_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_BUS_ID, bus))
+		return -EMSGSIZE;
+
+	return msg_query(nlh, callback, data);
+}
+
+struct mdio_xfer_data {
+	mdio_xfer_cb_t cb;
+	void *arg;
+	int err;
+
+	struct mdio_nl_report *report;
+	struct mdio_nl_state *state;
+	bool stopped;
+};
+
+static int mdio_xfer_cb(const struct nlmsghdr *nlh, void *_xfer)
+{
+	struct genlmsghdr *genl = mnl_nlmsg_get_payload(nlh);
+	struct nlattr *tb[MDIO_NLA_MAX + 1] = {};
+	struct mdio_xfer_data *xfer = _xfer;
+	uint32_t *data;
+	int len, err;
+
+	mnl_attr_parse(nlh, sizeof(*genl), parse_attrs, tb);
+
+	if (tb[MDIO_NLA_ERROR])
+		xfer->err = (int)mnl_attr_get_u32(tb[MDIO_NLA_ERROR]);
+
+	if (tb[MDIO_NLA_REPORT] && xfer->report &&
+	    mnl_attr_get_payload_len(tb[MDIO_NLA_REPORT]) >= sizeof(*xfer->report))
+		memcpy(xfer->report, mnl_attr_get_payload(tb[MDIO_NLA_REPORT]),
+		       sizeof(*xfer->report));
+
+	if (tb[MDIO_NLA_STATE] && xfer->state &&
+	    mnl_attr_get_payload_len(tb[MDIO_NLA_STATE]) >= sizeof(*xfer->state)) {
+		memcpy(xfer->state, mnl_attr_get_payload(tb[MDIO_NLA_STATE]),
+		       sizeof(*xfer->state));
+		xfer->stopped = true;
+	}
+
+	if (!tb[MDIO_NLA_DATA])
+		return MNL_CB_ERROR;
+
+	len = mnl_attr_get_payload_len(tb[MDIO_NLA_DATA]) / sizeof(uint32_t);
+	data = mnl_attr_get_payload(tb[MDIO_NLA_DATA]);
+
+	err = xfer->cb(data, len, xfer->err, xfer->arg);
+	return err ? MNL_CB_ERROR : MNL_CB_OK;
+}
+
+static bool mdio_state_is_initial(const struct mdio_nl_state *state)
+{
+	static const struct mdio_nl_state initial;
+
+	return !memcmp(state, &initial, sizeof(initial));
+}
+
+int mdio_ctx_xfer(struct mdio_ctx *ctx, const char *bus,
+		  struct mdio_prog *prog, mdio_xfer_cb_t cb, void *arg,
+		  uint32_t timeout_us)
+{
+	struct mdio_xfer_data xfer = {
+		.cb = cb, .arg = arg,
+		.report = prog->report, .state = prog->state
+	};
+	uint32_t flags = prog->flags;
+	struct nlmsghdr *nlh;
+	MDIO_MSG_BUF(buf);
+	bool fits;
+	int err;
+
+	nlh = msg_init(ctx, buf, MDIO_GENL_XFER, NLM_F_REQUEST | NLM_F_ACK);
+	if (!nlh)
+		return -ENOMEM;
+
+	if (!mnl_attr_put_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_PROG,
+				prog->len * sizeof(*prog->insns), prog->insns))
+		return -EMSGSIZE;
+
+	/* Only use the new attribute when it is needed, so that
+	 * whole milliseconds work with older kernels. */
+	if (timeout_us % 1000)
+		fits = mnl_attr_put_u32_check(nlh, MDIO_MSG_SIZE,
+					      MDIO_NLA_TIMEOUT_US, timeout_us);
+	else
+		fits = mnl_attr_put_u16_check(nlh, MDIO_MSG_SIZE,
+					      MDIO_NLA_TIMEOUT,
+					      timeout_us / 1000);
+	if (!fits)
+		return -EMSGSIZE;
+
+	if (prog->report)
+		flags |= MDIO_NL_F_REPORT;
+
+	if (flags &&
+	    !mnl_attr_put_u32_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_FLAGS, flags))
+		return -EMSGSIZE;
+
+	/* Older kernels never hand out a state, so they will never
+	 * be asked to resume from one. */
+	if (prog->state && !mdio_state_is_initial(prog->state) &&
+	    !mnl_attr_put_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_STATE,
+				sizeof(*prog->state), prog->state))
+		return -EMSGSIZE;
+
+	err = msg_query_bus(ctx, nlh, bus, mdio_xfer_cb, &xfer);
+
+	/* Start over the next time around, unless we were stopped */
+	if (prog->state && !xfer.stopped)
+		memset(prog->state, 0, sizeof(*prog->state));
+
+	return xfer.err ? : err;
+}
+
+int mdio_ctx_read_list(struct mdio_ctx *ctx, const char *bus,
+		       const struct mdio_nl_reg *regs, int n, uint32_t flags,
+		       mdio_xfer_cb_t cb, void *arg)
+{
+	struct mdio_xfer_data xfer = { .cb = cb, .arg = arg };
+	struct nlmsghdr *nlh;
+	MDIO_MSG_BUF(buf);
+	int err;
+
+	nlh = msg_init(ctx, buf, MDIO_GENL_READ_LIST,
+		       NLM_F_REQUEST | NLM_F_ACK);
+	if (!nlh)
+		return -ENOMEM;
+
+	if (!mnl_attr_put_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_REGS,
+				n * sizeof(*regs), regs) ||
+	    !mnl_attr_put_u16_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_TIMEOUT, 1000))
+		return -EMSGSIZE;
+
+	if (flags &&
+	    !mnl_attr_put_u32_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_FLAGS, flags))
+		return -EMSGSIZE;
+
+	err = msg_query_bus(ctx, nlh, bus, mdio_xfer_cb, &xfer);
+
+	/* Older versions of mdio-netlink do not know about register
+	 * lists, let the caller fall back to running a program. */
+	if (err == -EOPNOTSUPP)
+		return err;
+
+	return xfer.err ? : err;
+}
+
+int mdio_ctx_write_list(struct mdio_ctx *ctx, const char *bus,
+			const struct mdio_nl_write *writes, int n,
+			bool verify, mdio_xfer_cb_t cb, void *arg)
+{
+	struct mdio_xfer_data xfer = { .cb = cb, .arg = arg };
+	struct nlmsghdr *nlh;
+	MDIO_MSG_BUF(buf);
+	int err;
+
+	nlh = msg_init(ctx, buf, MDIO_GENL_WRITE_LIST,
+		       NLM_F_REQUEST | NLM_F_ACK);
+	if (!nlh)
+		return -ENOMEM;
+
+	if (!mnl_attr_put_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_WRITES,
+				n * sizeof(*writes), writes) ||
+	    !mnl_attr_put_u16_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_TIMEOUT, 1000))
+		return -EMSGSIZE;
+
+	if (verify &&
+	    !mnl_attr_put_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_VERIFY, 0, NULL))
+		return -EMSGSIZE;
+
+	err = msg_query_bus(ctx, nlh, bus, mdio_xfer_cb, &xfer);
+	if (err == -EOPNOTSUPP)
+		return err;
+
+	return xfer.err ? : err;
+}
+
+static int mdio_rate_cb(const struct nlmsghdr *nlh, void *_rate)
+{
+	struct genlmsghdr *genl = mnl_nlmsg_get_payload(nlh);
+	struct nlattr *tb[MDIO_NLA_MAX + 1] = {};
+	struct mdio_rate *rate = _rate;
+
+	mnl_attr_parse(nlh, sizeof(*genl), parse_attrs, tb);
+
+	if (!tb[MDIO_NLA_RATE] || !tb[MDIO_NLA_BURST] ||
+	    !tb[MDIO_NLA_THROTTLED] || !tb[MDIO_NLA_THROTTLED_NS])
+		return MNL_CB_ERROR;
+
+	rate->rate = mnl_attr_get_u32(tb[MDIO_NLA_RATE]);
+	rate->burst = mnl_attr_get_u32(tb[MDIO_NLA_BURST]);
+	rate->throttled = mnl_attr_get_u64(tb[MDIO_NLA_THROTTLED]);
+	rate->throttled_ns = mnl_attr_get_u64(tb[MDIO_NLA_THROTTLED_NS]);
+	return MNL_CB_OK;
+}
+
+static int mdio_rate_query(struct mdio_ctx *ctx, const char *bus,
+			   struct mdio_rate *rate, bool set)
+{
+	struct nlmsghdr *nlh;
+	MDIO_MSG_BUF(buf);
+
+	nlh = msg_init(ctx, buf, MDIO_GENL_RATE, NLM_F_REQUEST | NLM_F_ACK);
+	if (!nlh)
+		return -ENOMEM;
+
+	if (set) {
+		if (!mnl_attr_put_u32_check(nlh, MDIO_MSG_SIZE,
+					    MDIO_NLA_RATE, rate->rate))
+			return -EMSGSIZE;
+
+		/* Let the kernel pick a suitable default if no burst
+		 * size is specified. */
+		if (rate->burst &&
+		    !mnl_attr_put_u32_check(nlh, MDIO_MSG_SIZE,
+					    MDIO_NLA_BURST, rate->burst))
+			return -EMSGSIZE;
+	}
+
+	return msg_query_bus(ctx, nlh, bus, mdio_rate_cb, rate);
+}
+
+int mdio_ctx_rate_get(struct mdio_ctx *ctx, const char *bus,
+		      struct mdio_rate *rate)
+{
+	return mdio_rate_query(ctx, bus, rate, false);
+}
+
+int mdio_ctx_rate_set(struct mdio_ctx *ctx, const char *bus,
+		      struct mdio_rate *rate)
+{
+	return mdio_rate_query(ctx, bus, rate, true);
+}
+
+static int mdio_bus_info_parse(const struct nlmsghdr *nlh,
+			       struct mdio_bus_info *info)
+{
+	struct genlmsghdr *genl = mnl_nlmsg_get_payload(nlh);
+	struct nlattr *tb[MDIO_NLA_MAX + 1] = {};
+
+	mnl_attr_parse(nlh, sizeof(*genl), parse_attrs, tb);
+
+	if (!tb[MDIO_NLA_BUS_ID] || !tb[MDIO_NLA_BUS_CAPS] ||
+	    !tb[MDIO_NLA_ISA] || !tb[MDIO_NLA_PROG_MAX] ||
+	    !tb[MDIO_NLA_TIMEOUT_MAX])
+		return -EINVAL;
+
+	memset(info, 0, sizeof(*info));
+	strncpy(info->id, mnl_attr_get_str(tb[MDIO_NLA_BUS_ID]),
+		sizeof(info->id) - 1);
+	info->caps = mnl_attr_get_u32(tb[MDIO_NLA_BUS_CAPS]);
+	info->isa = mnl_attr_get_u32(tb[MDIO_NLA_ISA]);
+	info->prog_max = mnl_attr_get_u32(tb[MDIO_NLA_PROG_MAX]);
+	info->timeout_max = mnl_attr_get_u32(tb[MDIO_NLA_TIMEOUT_MAX]);
+
+	if (tb[MDIO_NLA_BUS_CLOCK])
+		info->clock = mnl_attr_get_u32(tb[MDIO_NLA_BUS_CLOCK]);
+
+	if (tb[MDIO_NLA_BUS_HANDLE])
+		info->handle = mnl_attr_get_u32(tb[MDIO_NLA_BUS_HANDLE]);
+
+	if (tb[MDIO_NLA_FLAGS])
+		info->flags = mnl_attr_get_u32(tb[MDIO_NLA_FLAGS]);
+
+	return 0;
+}
+
+static int mdio_bus_info_cb(const struct nlmsghdr *nlh, void *_info)
+{
+	return mdio_bus_info_parse(nlh, _info) ? MNL_CB_ERROR : MNL_CB_OK;
+}
+
+int mdio_ctx_bus_info(struct mdio_ctx *ctx, const char *bus,
+		      struct mdio_bus_info *info)
+{
+	struct nlmsghdr *nlh;
+	MDIO_MSG_BUF(buf);
+	int err;
+
+	nlh = msg_init(ctx, buf, MDIO_GENL_GET_BUSES,
+		       NLM_F_REQUEST | NLM_F_ACK);
+	if (!nlh)
+		return -ENOMEM;
+
+	if (!mnl_attr_put_strz_check(nlh, MDIO_MSG_SIZE, MDIO_NLA_BUS_ID, bus))
+		return -EMSGSIZE;
+
+	err = msg_query(nlh, mdio_bus_info_cb, info);
+	if (err < 0)
+		return err;
+
+	mdio_bus_cache_set(ctx, info->id, info->handle);
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->info_cache = *info;
+	pthread_mutex_unlock(&ctx->lock);
+	return 0;
+}
+
+static void mdio_bus_info_cached(struct mdio_ctx *ctx, const char *bus,
+				 struct mdio_bus_info *info)
+{
+	bool hit;
+
+	pthread_mutex_lock(&ctx->lock);
+	hit = !strcmp(ctx->info_cache.id, bus);
+	if (hit)
+		*info = ctx->info_cache;
+	pthread_mutex_unlock(&ctx->lock);
+
+	if (hit || !mdio_ctx_bus_info(ctx, bus, info))
+		return;
+
+	/* Remember the failure too, kernels without GET_BUSES would
+	 * otherwise be queried again for every capability check. */
+	memset(info, 0, sizeof(*info));
+	snprintf(info->id, sizeof(info->id), "%s", bus);
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->info_cache = *info;
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+bool mdio_ctx_bus_supports(struct mdio_ctx *ctx, const char *bus,
+			   enum mdio_nl_op op)
+{
+	struct mdio_bus_info info;
+
+	mdio_bus_info_cached(ctx, bus, &info);
+	return info.isa & BIT(op);
+}
+
+bool mdio_ctx_bus_has_flags(struct mdio_ctx *ctx, const char *bus,
+			    uint32_t flags)
+{
+	struct mdio_bus_info info;
+
+	mdio_bus_info_cached(ctx, bus, &info);
+	return (info.flags & flags) == flags;
+}
+
+struct mdio_bus_list {
+	struct mdio_bus_info *infos;
+	size_t len;
+};
+
+static int mdio_bus_list_cb(const struct nlmsghdr *nlh, void *_list)
+{
+	struct mdio_bus_list *list = _list;
+	struct mdio_bus_info *infos;
+
+	infos = realloc(list->infos, (list->len + 1) * sizeof(*infos));
+	if (!infos)
+		return MNL_CB_ERROR;
+
+	list->infos = infos;
+
+	if (mdio_bus_info_parse(nlh, &list->infos[list->len]))
+		return MNL_CB_ERROR;
+
+	list->len++;
+	return MNL_CB_OK;
+}
+
+static int mdio_for_each_nl(struct mdio_ctx *ctx, const char *match,
+			    int (*cb)(const char *bus, void *arg), void *arg)
+{
+	struct mdio_bus_list list = { 0 };
+	struct nlmsghdr *nlh;
+	MDIO_MSG_BUF(buf);
+	size_t i;
+	int err;
+
+	nlh = msg_init(ctx, buf, MDIO_GENL_GET_BUSES,
+		       NLM_F_REQUEST | NLM_F_DUMP);
+	if (!nlh)
+		return -ENOMEM;
+
+	/* Collect the whole list before calling back, so that
+	 * callbacks are free to issue requests of their own. */
+	err = msg_query(nlh, mdio_bus_list_cb, &list);
+	if (err < 0)
+		goto out;
+
+	for (err = 0, i = 0; i < list.len; i++) {
+		if (fnmatch(match, list.infos[i].id, 0))
+			continue;
+
+		mdio_bus_cache_set(ctx, list.infos[i].id,
+				   list.infos[i].handle);
+
+		err = cb(list.infos[i].id, arg);
+		if (err)
+			break;
+	}
+
+out:
+	free(list.infos);
+	return err;
+}
+
+static int mdio_for_each_sysfs(const char *match,
+			       int (*cb)(const char *bus, void *arg), void *arg)
+{
+	char gmatch[0x80];
+	glob_t gl;
+	size_t i;
+	int err;
+
+	snprintf(gmatch, sizeof(gmatch), "/sys/class/mdio_bus/%s", match);
+	glob(gmatch, 0, NULL, &gl);
+
+	for (err = 0, i = 0; i < gl.gl_pathc; i++) {
+		err = cb(&gl.gl_pathv[i][strlen("/sys/class/mdio_bus/")], arg);
+		if (err)
+			break;
+	}
+
+	globfree(&gl);
+	return err;
+}
+
+int mdio_ctx_for_each(struct mdio_ctx *ctx, const char *match,
+		      int (*cb)(const char *bus, void *arg), void *arg)
+{
+	int err;
+
+	err = mdio_for_each_nl(ctx, match, cb, arg);
+	if (err >= 0)
+		return err;
+
+	/* Older versions of mdio-netlink can not enumerate buses,
+	 * fall back to scanning sysfs. */
+	return mdio_for_each_sysfs(match, cb, arg);
+}
+
+struct mdio_bus_monitor {
+	struct mdio_ctx *ctx;
+
+	int (*cb)(const struct mdio_bus_info *info, bool added, void *arg);
+	void *arg;
+};
+
+static int mdio_bus_monitor_cb(const struct nlmsghdr *nlh, void *_mon)
+{
+	struct genlmsghdr *genl = mnl_nlmsg_get_payload(nlh);
+	struct mdio_bus_monitor *mon = _mon;
+	struct mdio_bus_info info;
+
+	if (nlh->nlmsg_type != mon->ctx->family)
+		return MNL_CB_OK;
+
+	switch (genl->cmd) {
+	case MDIO_GENL_NEW_BUS:
+	case MDIO_GENL_DEL_BUS:
+		break;
+	default:
+		return MNL_CB_OK;
+	}
+
+	if (mdio_bus_info_parse(nlh, &info))
+		return MNL_CB_ERROR;
+
+	if (mon->cb(&info, genl->cmd == MDIO_GENL_NEW_BUS, mon->arg))
+		return MNL_CB_STOP;
+
+	return MNL_CB_OK;
+}
+
+int mdio_ctx_bus_monitor(struct mdio_ctx *ctx,
+			 int (*cb)(const struct mdio_bus_info *info,
+				   bool added, void *arg), void *arg)
+{
+	struct mdio_bus_monitor mon = { .ctx = ctx, .cb = cb, .arg = arg };
+	struct mnl_socket *nl;
+	MDIO_MSG_BUF(buf);
+	int ret;
+
+	if (!ctx->mcgrp_bus)
+		return -ENOTSUP;
+
+	nl = mnl_socket_open(NETLINK_GENERIC);
+	if (!nl)
+		return -errno;
+
+	ret = mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID);
+	if (ret < 0)
+		goto out;
+
+	ret = mnl_socket_setsockopt(nl, NETLINK_ADD_MEMBERSHIP,
+				    &ctx->mcgrp_bus, sizeof(ctx->mcgrp_bus));
+	if (ret < 0)
+		goto out;
+
+	do {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret <= 0)
+			break;
+
+		ret = mnl_cb_run(buf, ret, 0, 0, mdio_bus_monitor_cb, &mon);
+	} while (ret > 0);
+
+out:
+	if (ret < 0)
+		ret = -errno;
+
+	mnl_socket_close(nl);
+	return ret;
+}
+
+static int family_mcgrp_cb(const struct nlattr *grp, void *_ctx)
+{
+	struct nlattr *tb[CTRL_ATTR_MCAST_GRP_MAX + 1] = {};
+	struct mdio_ctx *ctx = _ctx;
+
+	mnl_attr_parse_nested(grp, parse_attrs, tb);
+	if (!tb[CTRL_ATTR_MCAST_GRP_NAME] || !tb[CTRL_ATTR_MCAST_GRP_ID])
+		return MNL_CB_OK;
+
+	if (!strcmp(mnl_attr_get_str(tb[CTRL_ATTR_MCAST_GRP_NAME]),
+		    MDIO_GENL_MCGRP_BUS_NAME))
+		ctx->mcgrp_bus = mnl_attr_get_u32(tb[CTRL_ATTR_MCAST_GRP_ID]);
+
+	return MNL_CB_OK;
+}
+
+static int family_id_cb(const struct nlmsghdr *nlh, void *_ctx)
+{
+	struct genlmsghdr *genl = mnl_nlmsg_get_payload(nlh);
+	struct nlattr *tb[CTRL_ATTR_MAX + 1] = {};
+	struct mdio_ctx *ctx = _ctx;
+	struct nlattr *grp;
+
+	mnl_attr_parse(nlh, sizeof(*genl), parse_attrs, tb);
+	if (!tb[CTRL_ATTR_FAMILY_ID])
+		return MNL_CB_ERROR;
+
+	ctx->family = mnl_attr_get_u16(tb[CTRL_ATTR_FAMILY_ID]);
+
+	/* Older versions of mdio-netlink do not send any bus events. */
+	if (tb[CTRL_ATTR_MCAST_GROUPS]) {
+		mnl_attr_for_each_nested(grp, tb[CTRL_ATTR_MCAST_GROUPS])
+			family_mcgrp_cb(grp, ctx);
+	}
+
+	return MNL_CB_OK;
+}
+
+int mdio_modprobe(void)
+{
+	int wstatus;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		return -errno;
+	} else if (!pid) {
+		execl("/sbin/modprobe", "modprobe", "mdio-netlink", NULL);
+		_exit(1);
+	}
+
+	if (waitpid(pid, &wstatus, 0) <= 0)
+		return -ECHILD;
+
+	if (WIFEXITED(wstatus) && !WEXITSTATUS(wstatus))
+		return 0;
+
+	return -EPERM;
+}
+
+struct mdio_ctx *mdio_ctx_new(void)
+{
+	struct genlmsghdr *genl;
+	struct mdio_ctx *ctx;
+	struct nlmsghdr *nlh;
+	MDIO_MSG_BUF(buf);
+	int err;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type	= GENL_ID_CTRL;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+
+	genl = mnl_nlmsg_put_extra_header(nlh, sizeof(struct genlmsghdr));
+	genl->cmd = CTRL_CMD_GETFAMILY;
+	genl->version = 1;
+
+	mnl_attr_put_u16(nlh, CTRL_ATTR_FAMILY_ID, GENL_ID_CTRL);
+	mnl_attr_put_strz(nlh, CTRL_ATTR_FAMILY_NAME, "mdio");
+
+	err = msg_query(nlh, family_id_cb, ctx);
+	if (err < 0 || !ctx->family) {
+		err = (err < 0) ? -err : ENOENT;
+		free(ctx);
+		errno = err;
+		return NULL;
+	}
+
+	pthread_mutex_init(&ctx->lock, NULL);
+	return ctx;
+}
+
+void mdio_ctx_free(struct mdio_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	pthread_mutex_destroy(&ctx->lock);
+	free(ctx);
+}
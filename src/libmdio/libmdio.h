@@ -0,0 +1,151 @@
+#ifndef _LIBMDIO_H
+#define _LIBMDIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/mdio-netlink.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Program construction */
+
+#define MDIO_REG(_r) ((MDIO_NL_ARG_REG << 16) | ((uint16_t)(_r)))
+#define MDIO_IMM(_n) ((MDIO_NL_ARG_IMM << 16) | ((uint16_t)(_n)))
+#define MDIO_GOTO(_from, _to) \
+	((MDIO_NL_ARG_IMM << 16) | ((uint16_t)((_to) - (_from) - 1)))
+
+#define MDIO_INSN(_op, _a0, _a1, _a2)		\
+	((struct mdio_nl_insn)			\
+	{					\
+		.op = MDIO_NL_OP_ ## _op,	\
+		.arg0 = _a0,			\
+		.arg1 = _a1,			\
+		.arg2 = _a2			\
+	})
+
+struct mdio_prog {
+	struct mdio_nl_insn *insns;
+	int len;
+
+	uint32_t flags;		/* MDIO_NL_F_* */
+
+	/* If set, the kernel's execution report is stored here. Only
+	 * request it from buses supporting MDIO_NL_F_REPORT. */
+	struct mdio_nl_report *report;
+
+	/* If set, execution starts from this state, which should be
+	 * zeroed for a fresh start. When the program times out, the
+	 * point at which it stopped is stored back, so that it can be
+	 * resumed by running it again. Otherwise it is zeroed. */
+	struct mdio_nl_state *state;
+};
+#define MDIO_PROG_EMPTY ((struct mdio_prog) { 0 })
+#define MDIO_PROG_FIXED(_insns)					\
+	((struct mdio_prog)					\
+	{							\
+		.insns = _insns,				\
+		.len = sizeof(_insns) / sizeof((_insns)[0])	\
+	})
+
+/* Append an instruction to a program, growing it as needed. Returns
+ * -ENOMEM if it could not be grown, in which case the program is
+ * left as it was. */
+int mdio_prog_push(struct mdio_prog *prog, struct mdio_nl_insn insn);
+
+/* Release the instructions of a program built by mdio_prog_push(),
+ * leaving it empty. */
+void mdio_prog_free(struct mdio_prog *prog);
+
+/* Contexts
+ *
+ * A context holds everything needed to talk to mdio-netlink. All
+ * functions taking a context may be called concurrently from
+ * multiple threads, on the same context or on different ones. Each
+ * call uses a netlink socket of its own. */
+
+struct mdio_ctx;
+
+/* Create a context, or return NULL and set errno. Fails with ENOENT
+ * if mdio-netlink is not loaded, see mdio_modprobe(). */
+struct mdio_ctx *mdio_ctx_new(void);
+void mdio_ctx_free(struct mdio_ctx *ctx);
+
+/* Try to load mdio-netlink, returns 0 on success. */
+int mdio_modprobe(void);
+
+/* Transfers
+ *
+ * Data emitted by the program is delivered to the callback, which
+ * may be called multiple times for large outputs. Only the final
+ * call carries the program's error, if any. A non-zero return from
+ * the callback aborts the transfer. All functions return zero on
+ * success, or a negative errno. Requests that do not fit in a
+ * single netlink message fail with -EMSGSIZE. */
+
+typedef int (*mdio_xfer_cb_t)(uint32_t *data, int len, int err, void *arg);
+
+int mdio_ctx_xfer(struct mdio_ctx *ctx, const char *bus,
+		  struct mdio_prog *prog, mdio_xfer_cb_t cb, void *arg,
+		  uint32_t timeout_us);
+int mdio_ctx_read_list(struct mdio_ctx *ctx, const char *bus,
+		       const struct mdio_nl_reg *regs, int n, uint32_t flags,
+		       mdio_xfer_cb_t cb, void *arg);
+int mdio_ctx_write_list(struct mdio_ctx *ctx, const char *bus,
+			const struct mdio_nl_write *writes, int n,
+			bool verify, mdio_xfer_cb_t cb, void *arg);
+
+/* Buses */
+
+struct mdio_rate {
+	uint32_t rate;
+	uint32_t burst;
+
+	uint64_t throttled;
+	uint64_t throttled_ns;
+};
+
+int mdio_ctx_rate_get(struct mdio_ctx *ctx, const char *bus,
+		      struct mdio_rate *rate);
+int mdio_ctx_rate_set(struct mdio_ctx *ctx, const char *bus,
+		      struct mdio_rate *rate);
+
+struct mdio_bus_info {
+	char id[64];
+	uint32_t handle;
+	uint32_t caps;
+	uint32_t clock;
+
+	uint32_t isa;
+	uint32_t flags;
+	uint32_t prog_max;
+	uint32_t timeout_max;
+};
+
+int mdio_ctx_bus_info(struct mdio_ctx *ctx, const char *bus,
+		      struct mdio_bus_info *info);
+
+/* Backed by a per-context cache of the last bus asked about, since
+ * program generators tend to ask about the same bus repeatedly. */
+bool mdio_ctx_bus_supports(struct mdio_ctx *ctx, const char *bus,
+			   enum mdio_nl_op op);
+bool mdio_ctx_bus_has_flags(struct mdio_ctx *ctx, const char *bus,
+			    uint32_t flags);
+
+/* Call cb for each bus whose name matches the fnmatch(3) pattern,
+ * until it returns non-zero, which is then returned. */
+int mdio_ctx_for_each(struct mdio_ctx *ctx, const char *match,
+		      int (*cb)(const char *bus, void *arg), void *arg);
+
+/* Call cb for each bus added or removed, until it returns non-zero.
+ * Blocks the calling thread. */
+int mdio_ctx_bus_monitor(struct mdio_ctx *ctx,
+			 int (*cb)(const struct mdio_bus_info *info,
+				   bool added, void *arg), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _LIBMDIO_H */
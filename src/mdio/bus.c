@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,18 +16,36 @@ static int bus_status_cb(uint32_t *data, int len, int err, void *_null)
 
 	printf("\e[7m%4s  %10s  %4s\e[0m\n", "DEV", "PHY-ID", "LINK");
 	for (dev = 0; dev < MDIO_DEV_MAX; dev++, data += 3) {
-		if (data[1] == 0xffff && data[2] == 0xffff)
+		/* Unreadable IDs are reported as 0xffff, i.e. the
+		 * device is treated as absent. */
+		if ((data[1] & 0xffff) == 0xffff && (data[2] & 0xffff) == 0xffff)
 			continue;
 
 		printf("0x%2.2x  0x%8.8x  %s\n", dev,
-		       (data[1] << 16) | data[2],
+		       ((data[1] & 0xffff) << 16) | (data[2] & 0xffff),
+		       (data[0] & MDIO_NL_DATA_ERR) ? "error" :
 		       (data[0] & BMSR_LSTATUS) ? "up" : "down");
 	}
 
 	return err;
 }
 
-int bus_status(const char *bus)
+static int bus_status_list(const char *bus)
+{
+	struct mdio_nl_reg regs[MDIO_DEV_MAX * 3];
+	uint16_t dev;
+
+	for (dev = 0; dev < MDIO_DEV_MAX; dev++) {
+		regs[dev * 3 + 0] = (struct mdio_nl_reg) { dev, MII_BMSR };
+		regs[dev * 3 + 1] = (struct mdio_nl_reg) { dev, MII_PHYSID1 };
+		regs[dev * 3 + 2] = (struct mdio_nl_reg) { dev, MII_PHYSID2 };
+	}
+
+	return mdio_read_list(bus, regs, MDIO_DEV_MAX * 3, MDIO_NL_F_NONFATAL,
+			      bus_status_cb, NULL);
+}
+
+static int bus_status_prog(const char *bus)
 {
 	struct mdio_nl_insn insns[] = {
 		INSN(ADD,  IMM(0), IMM(0),  REG(1)),
@@ -41,9 +61,18 @@ int bus_status(const char *bus)
 		INSN(JNE, REG(1), IMM(MDIO_DEV_MAX), IMM(-8)),
 	};
 	struct mdio_prog prog = MDIO_PROG_FIXED(insns);
+
+	return mdio_xfer(bus, &prog, bus_status_cb, NULL);
+}
+
+int bus_status(const char *bus)
+{
 	int err;
 
-	err = mdio_xfer(bus, &prog, bus_status_cb, NULL);
+	err = bus_status_list(bus);
+	if (err == -EOPNOTSUPP)
+		err = bus_status_prog(bus);
+
 	if (err) {
 		fprintf(stderr, "ERROR: Unable to read status (%d)\n", err);
 		return 1;
@@ -63,3 +92,290 @@ int bus_list(void)
 	mdio_for_each("*", bus_list_cb, NULL);
 	return 0;
 }
+
+static int bus_monitor_cb(const struct mdio_bus_info *info, bool added,
+			  void *_null)
+{
+	printf("%c %s\n", added ? '+' : '-', info->id);
+	fflush(stdout);
+	return 0;
+}
+
+int bus_monitor(void)
+{
+	int err;
+
+	err = mdio_bus_monitor(bus_monitor_cb, NULL);
+	if (err == -ENOTSUP)
+		fprintf(stderr, "ERROR: Bus events not supported by kernel\n");
+	else if (err < 0)
+		fprintf(stderr, "ERROR: Monitor failed (%d)\n", err);
+
+	return err;
+}
+
+static int bus_rate_parse(const char *str, uint32_t *val)
+{
+	unsigned long v;
+	char *end;
+
+	errno = 0;
+	v = strtoul(str, &end, 0);
+	if (errno || *end || v > UINT32_MAX) {
+		fprintf(stderr, "ERROR: \"%s\" is not a valid rate\n", str);
+		return EINVAL;
+	}
+
+	*val = v;
+	return 0;
+}
+
+static int bus_rate_exec(const char *bus, int argc, char **argv)
+{
+	struct mdio_rate rate = { 0 };
+	bool set = false;
+	char *arg;
+	int err;
+
+	arg = argv_pop(&argc, &argv);
+	if (arg) {
+		set = true;
+		if (bus_rate_parse(arg, &rate.rate))
+			return 1;
+	}
+
+	arg = argv_pop(&argc, &argv);
+	if (arg) {
+		if (bus_rate_parse(arg, &rate.burst))
+			return 1;
+
+		if (!rate.burst) {
+			fprintf(stderr, "ERROR: Burst size must be non-zero\n");
+			return 1;
+		}
+	}
+
+	if (argv_peek(argc, argv)) {
+		fprintf(stderr, "ERROR: Unexpected argument\n");
+		return 1;
+	}
+
+	err = set ? mdio_rate_set(bus, &rate) : mdio_rate_get(bus, &rate);
+	if (err) {
+		fprintf(stderr, "ERROR: Rate operation failed (%d)\n", err);
+		return 1;
+	}
+
+	if (rate.rate)
+		printf("rate:       %"PRIu32" ops/s, burst %"PRIu32"\n",
+		       rate.rate, rate.burst);
+	else
+		puts("rate:       unlimited");
+
+	printf("throttled:  %"PRIu64" transfers, %"PRIu64".%03"PRIu64"s\n",
+	       rate.throttled, rate.throttled_ns / 1000000000,
+	       (rate.throttled_ns / 1000000) % 1000);
+	return 0;
+}
+DEFINE_CMD("rate", bus_rate_exec);
+
+static int bus_info_exec(const char *bus, int argc, char **argv)
+{
+	struct mdio_bus_info info;
+	int err;
+
+	if (argv_peek(argc, argv)) {
+		fprintf(stderr, "ERROR: Unexpected argument\n");
+		return 1;
+	}
+
+	err = mdio_bus_info(bus, &info);
+	if (err) {
+		fprintf(stderr, "ERROR: Unable to read bus info (%d)\n", err);
+		return 1;
+	}
+
+	if (info.handle)
+		printf("handle:     %"PRIu32"\n", info.handle);
+
+	printf("clause-22:  %s\n",
+	       (info.caps & BIT(MDIO_NL_BUS_CAP_C22)) ? "yes" : "no");
+	printf("clause-45:  %s\n",
+	       (info.caps & BIT(MDIO_NL_BUS_CAP_C45)) ? "yes" : "no");
+
+	if (info.clock)
+		printf("clock:      %"PRIu32" Hz\n", info.clock);
+	else
+		puts("clock:      unknown");
+
+	printf("isa:        %#"PRIx32"\n", info.isa);
+	printf("program:    %"PRIu32" instructions, %"PRIu32"ms\n",
+	       info.prog_max, info.timeout_max);
+	return 0;
+}
+DEFINE_CMD("info", bus_info_exec);
+
+/* Number of writes per transfer, leaving room in the message buffer
+ * for headers and the remaining attributes. */
+#define BUS_APPLY_CHUNK 256
+
+struct bus_apply {
+	struct mdio_nl_write *writes;
+	int n;
+	int mismatches;
+};
+
+static int bus_apply_parse(const char *file, int lineno, char *line,
+			   struct mdio_nl_write *w)
+{
+	char *dev, *reg, *val, *end;
+	unsigned long r, v, m = 0;
+
+	dev = strtok(line, " \t\n");
+	reg = strtok(NULL, " \t\n");
+	val = strtok(NULL, " \t\n");
+	if (!dev || !reg || !val || strtok(NULL, " \t\n"))
+		goto err_invalid;
+
+	if (mdio_parse_dev(dev, &w->dev, true))
+		goto err_invalid;
+
+	r = strtoul(reg, &end, 0);
+	if (*end || r > ((w->dev & MDIO_PHY_ID_C45) ? 0xffff : 31))
+		goto err_invalid;
+
+	v = strtoul(val, &end, 0);
+	if (*end == '/')
+		m = strtoul(end + 1, &end, 0);
+	if (*end || v > 0xffff || m > 0xffff)
+		goto err_invalid;
+
+	w->reg = r;
+	w->val = v;
+	w->mask = m;
+	return 0;
+
+err_invalid:
+	fprintf(stderr, "ERROR: %s:%d: Expected \"DEV REG DATA[/MASK]\"\n",
+		file, lineno);
+	return EINVAL;
+}
+
+static int bus_apply_read(const char *file, struct bus_apply *apply)
+{
+	struct mdio_nl_write *writes;
+	char line[0x100], *str;
+	int lineno, err = 0;
+	FILE *fp;
+
+	fp = strcmp(file, "-") ? fopen(file, "r") : stdin;
+	if (!fp) {
+		fprintf(stderr, "ERROR: Unable to open %s\n", file);
+		return errno;
+	}
+
+	for (lineno = 1; fgets(line, sizeof(line), fp); lineno++) {
+		str = line + strspn(line, " \t");
+		if (*str == '#' || *str == '\n' || !*str)
+			continue;
+
+		writes = realloc(apply->writes,
+				 (apply->n + 1) * sizeof(*writes));
+		if (!writes) {
+			err = ENOMEM;
+			break;
+		}
+
+		apply->writes = writes;
+
+		err = bus_apply_parse(file, lineno, str,
+				      &apply->writes[apply->n]);
+		if (err)
+			break;
+
+		apply->n++;
+	}
+
+	if (fp != stdin)
+		fclose(fp);
+
+	return err;
+}
+
+static int bus_apply_cb(uint32_t *data, int len, int err, void *_apply)
+{
+	struct bus_apply *apply = _apply;
+	struct mdio_nl_write *w;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if ((int)(data[i] >> 16) >= apply->n)
+			return 1;
+
+		w = &apply->writes[data[i] >> 16];
+
+		if (w->dev & MDIO_PHY_ID_C45)
+			printf("%u:%u", (w->dev & MDIO_PHY_ID_PRTAD) >> 5,
+			       w->dev & MDIO_PHY_ID_DEVAD);
+		else
+			printf("%u", w->dev);
+
+		printf(" %#x: wrote %#6.4x, read back %#6.4x\n", w->reg,
+		       w->val, data[i] & 0xffff);
+	}
+
+	apply->mismatches += len;
+	return err;
+}
+
+static int bus_apply_exec(const char *bus, int argc, char **argv)
+{
+	struct bus_apply apply = { 0 };
+	struct bus_apply chunk;
+	bool verify = false;
+	char *file = "-";
+	int err, i;
+
+	if (argv_peek(argc, argv) && !strcmp(argv_peek(argc, argv), "verify")) {
+		argv_pop(&argc, &argv);
+		verify = true;
+	}
+
+	if (argv_peek(argc, argv))
+		file = argv_pop(&argc, &argv);
+
+	if (argv_peek(argc, argv)) {
+		fprintf(stderr, "ERROR: Unexpected argument\n");
+		return 1;
+	}
+
+	err = bus_apply_read(file, &apply);
+	if (err)
+		goto out;
+
+	for (i = 0; i < apply.n; i += BUS_APPLY_CHUNK) {
+		chunk = (struct bus_apply) {
+			.writes = &apply.writes[i],
+			.n = apply.n - i < BUS_APPLY_CHUNK ?
+			     apply.n - i : BUS_APPLY_CHUNK,
+		};
+
+		err = mdio_write_list(bus, chunk.writes, chunk.n, verify,
+				      bus_apply_cb, &chunk);
+		if (err) {
+			fprintf(stderr, "ERROR: Unable to apply writes (%d)\n",
+				err);
+			goto out;
+		}
+
+		apply.mismatches += chunk.mismatches;
+	}
+
+	if (apply.mismatches)
+		err = EIO;
+
+out:
+	free(apply.writes);
+	return err ? 1 : 0;
+}
+DEFINE_CMD("apply", bus_apply_exec);
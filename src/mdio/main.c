@@ -11,17 +11,30 @@ int usage(int rc, FILE *fp)
 {
 	fputs("SYNOPSIS\n"
 	      "    mdio            -- List available buses\n"
+	      "    mdio -m         -- Monitor buses being added or removed\n"
 	      "    mdio BUS        -- Probe BUS for active devices\n"
 	      "    mdio BUS OBJ    -- Show status of OBJ\n"
 	      "    mdio BUS OBJ OP -- Perform OP on OBJ\n"
+	      "    mdio BUS info   -- Show capabilities of BUS\n"
+	      "    mdio BUS apply [verify] [FILE]\n"
+	      "                    -- Apply register writes listed in FILE\n"
+	      "    mdio BUS rate [OPS [BURST]]\n"
+	      "                    -- Show, or limit, the rate of operations on BUS\n"
 	      "\n"
 	      "OPTIONS\n"
 	      "  -h   This help text\n"
+	      "  -m   Monitor bus events, \"+ BUS\" is printed when BUS is added,\n"
+	      "       and \"- BUS\" when it is removed\n"
 	      "  -v   Show verision and contact information\n"
 	      "\n"
 	      "Bus names may be abbreviated using glob(3) syntax, i.e. \"fixed*\"\n"
 	      "would typically match against \"fixed-0\".\n"
 	      "\n"
+	      "Each line of an apply FILE (default: stdin) holds one write on the\n"
+	      "form \"DEV REG DATA[/MASK]\", where DEV is either PHYAD or\n"
+	      "PRTAD:DEVAD. With verify, each register is read back and any\n"
+	      "mismatches are reported.\n"
+	      "\n"
 	      "OBJECTS\n"
 	      "  phy PHYAD\n"
 	      "    Clause 22 (MDIO) PHY using address PHYAD.\n"
@@ -71,11 +84,23 @@ int usage(int rc, FILE *fp)
 	      "    DATA: u16\n"
 	      "    MASK: u16\n"
 	      "\n"
- 	      "  bench REG [DATA]\n"
-	      "    Benchmark read performance. If DATA is supplied, it is written to REG,\n"
-	      "    otherwise the current value in REG is read. REG is then read 1000\n"
-	      "    times. Any unexpected values are reported, along with the total time.\n"
-	      "\n"
+ 	      "  bench [read|write|rmw] [count COUNT] [workers N] [json] REG[,REG...] [DATA]\n"
+	      "    Benchmark register access. If DATA is supplied, it is written to each\n"
+	      "    REG, otherwise their current values are read. Each REG is then read,\n"
+	      "    written back, or both (rmw), COUNT (default: 1000) times. Reads of\n"
+	      "    unexpected values are reported, along with the total time, and the\n"
+	      "    time spent in the kernel, when available. When the bus supports\n"
+	      "    timestamps, the p50, p99 and max latency of each access is shown.\n"
+	      "    The cost of each access, in instructions generated by the driver,\n"
+	      "    and MDIO operations and time in the kernel, is reported as well.\n"
+	      "    With json, the results are printed as a single JSON object.\n"
+	      "    With N workers, that many processes run the benchmark in parallel,\n"
+	      "    each only holding the bus lock for one access at a time, when\n"
+	      "    supported. Their individual results are reported, along with the\n"
+	      "    total throughput and how fairly the bus was shared between them.\n"
+	      "\n"
+	      "    COUNT: 1-65535\n"
+	      "    N: 1-65535\n"
 	      "    DATA: u16\n"
 	      "\n"
 	      "EXAMPLES\n"
@@ -129,13 +154,17 @@ int bus_list_cb(const char *bus, void *_null)
 int main(int argc, char **argv)
 {
 	struct cmd *cmd;
-	char *arg, *bus;
+	char *arg, *bus, *sim;
+	bool monitor = false;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "hv")) != -1) {
+	while ((opt = getopt(argc, argv, "hmv")) != -1) {
 		switch (opt) {
 		case 'h':
 			return usage(0, stdout);
+		case 'm':
+			monitor = true;
+			break;
 		case 'v':
 			return version();
 		default:
@@ -146,7 +175,11 @@ int main(int argc, char **argv)
 	argv += optind;
 	argc -= optind;
 
-	if (mdio_init()) {
+	sim = getenv("MDIO_SIM");
+	if (sim) {
+		if (mdio_sim_init(sim))
+			return 1;
+	} else if (mdio_init()) {
 		if (mdio_modprobe()) {
 			fprintf(stderr, "ERROR: mdio-netlink module not "
 				"detected, and could not be loaded.\n");
@@ -159,6 +192,9 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (monitor)
+		return bus_monitor() ? 1 : 0;
+
 	arg = argv_pop(&argc, &argv);
 	if (!arg)
 		return bus_list() ? 1 : 0;
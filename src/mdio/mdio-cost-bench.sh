@@ -0,0 +1,132 @@
+#!/bin/sh
+# Compare the cost of the addressing modes implemented by mdio's
+# drivers, by running the same workload, COUNT reads and COUNT writes
+# of each of a set of registers, through each of them.
+#
+# Accessing a single register over and over again would let the MMD
+# address cache and page tracking skip most of the indirection that
+# these modes add. So the default cases alternate between registers,
+# pages or switch ports, which is the worst case for all of them.
+#
+# By default, the cases below are run against mdio's in-process
+# simulation backend, which makes the results deterministic. With -f,
+# cases are instead read from FILE, one "BUS DRIVER DEV REG" per
+# line, and run against real hardware unless MDIO_SIM is set. REG may
+# be a comma separated list, as for "mdio ... bench".
+
+usage()
+{
+	cat <<EOF
+Usage: $0 [-h] [-n COUNT] [-f FILE]
+
+Report, for each case and access type, the number of instructions
+generated by the driver, the number of MDIO frames on the wire and the
+time spent per logical register access. A native Clause 45 access is
+two frames, an address frame and a data frame.
+
+  -f FILE   Read cases from FILE, one "BUS DRIVER DEV REG" per line
+  -n COUNT  Accesses per case and type (default: 1000)
+
+The mdio binary used is taken from \$MDIO, if set, otherwise the one
+next to this script, otherwise the one in \$PATH.
+EOF
+}
+
+count=1000
+cases=
+
+while getopts "hf:n:" opt; do
+	case $opt in
+	h)
+		usage
+		exit 0
+		;;
+	f)
+		cases="$OPTARG"
+		;;
+	n)
+		count="$OPTARG"
+		;;
+	*)
+		usage >&2
+		exit 1
+		;;
+	esac
+done
+
+if [ -z "$MDIO" ]; then
+	MDIO="$(dirname "$0")/mdio"
+	[ -x "$MDIO" ] || MDIO=mdio
+fi
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+if [ -z "$cases" ]; then
+	# A native Clause 45 bus, and a Clause 22 only bus with a plain
+	# PHY, a paged PHY, a multi-chip LinkStreet switch and an XRS
+	# switch. A single-chip LinkStreet switch occupies an entire
+	# bus of its own.
+	cat >"$tmp/sim.desc" <<EOF
+bus c45 c45
+phy 1
+bus c22
+phy 1
+phy 2 paged 22
+mvls 4
+phy 5
+bus sc
+phy 2
+EOF
+	cat >"$tmp/cases" <<EOF
+c22 phy     1    4,5
+c45 mmd     1:1  4,5
+c22 mmd     1:1  4,5
+c22 mmd-c22 1:1  4,5
+c22 mva     2    0:4,1:4
+sc  mvls    0    2:4,3:4
+c22 mvls    4    2:4,3:4
+c22 xrs     5    0x10,0x12
+EOF
+	cases="$tmp/cases"
+	MDIO_SIM="$tmp/sim.desc"
+	export MDIO_SIM
+fi
+
+# Extract a member of the "per_op" object from bench's JSON output
+per_op()
+{
+	sed -n "s/.*\"per_op\":{[^}]*\"$1\":\([0-9.]*\).*/\1/p"
+}
+
+printf "%-8s  %-8s  %-6s  %-10s  %-5s  %8s  %8s  %10s\n" \
+       BUS DRIVER DEV REG TYPE INSNS FRAMES NS
+
+rc=0
+while read -r bus driver dev reg; do
+	case "$bus" in
+	""|\#*)
+		continue
+		;;
+	esac
+
+	for mode in read write; do
+		if ! "$MDIO" "$bus" "$driver" "$dev" bench "$mode" \
+		     count "$count" json "$reg" >"$tmp/out"; then
+			echo "ERROR: $bus $driver $dev $reg: $mode failed" >&2
+			rc=1
+			continue
+		fi
+
+		# Older versions of mdio-netlink do not count frames
+		frames=$(per_op frames <"$tmp/out")
+
+		printf "%-8s  %-8s  %-6s  %-10s  %-5s  %8s  %8s  %10s\n" \
+		       "$bus" "$driver" "$dev" "$reg" "$mode" \
+		       "$(per_op insns <"$tmp/out")" \
+		       "${frames:--}" \
+		       "$(per_op ns <"$tmp/out")"
+	done
+done <"$cases"
+
+exit $rc
@@ -1,14 +1,12 @@
 #include <assert.h>
 #include <errno.h>
-#include <glob.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <libmnl/libmnl.h>
-#include <linux/genetlink.h>
+#include <unistd.h>
 #include <linux/mdio.h>
 #include <linux/mdio-netlink.h>
 #include <sys/types.h>
@@ -16,101 +14,9 @@
 
 #include "mdio.h"
 
-static char buf[0x1000] __attribute__ ((aligned (NLMSG_ALIGNTO)));
-static const size_t len = 0x1000;
-static uint16_t mdio_family;
-
-static int parse_attrs(const struct nlattr *attr, void *data)
-{
-	const struct nlattr **tb = data;
-	int type = mnl_attr_get_type(attr);
-
-	tb[type] = attr;
-
-	return MNL_CB_OK;
-}
-
-static struct mnl_socket *msg_send(int bus, struct nlmsghdr *nlh)
-{
-	struct mnl_socket *nl;
-	int ret;
-
-	nl = mnl_socket_open(bus);
-	if (nl == NULL) {
-		perror("mnl_socket_open");
-		return NULL;
-	}
-
-	ret = mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID);
-	if (ret < 0) {
-		perror("mnl_socket_bind");
-		return NULL;
-	}
-
-	ret = mnl_socket_sendto(nl, nlh, nlh->nlmsg_len);
-	if (ret < 0) {
-		perror("mnl_socket_send");
-		return NULL;
-	}
-
-	return nl;
-}
-
-static int msg_recv(struct mnl_socket *nl, mnl_cb_t callback, void *data, int seq)
-{
-	unsigned int portid;
-	int ret;
-
-	portid = mnl_socket_get_portid(nl);
-
-	ret = mnl_socket_recvfrom(nl, buf, len);
-	while (ret > 0) {
-		ret = mnl_cb_run(buf, ret, seq, portid, callback, data);
-		if (ret <= 0)
-			break;
-		ret = mnl_socket_recvfrom(nl, buf, len);
-	}
-
-	return ret;
-}
-
-static int msg_query(struct nlmsghdr *nlh, mnl_cb_t callback, void *data)
-{
-	unsigned int seq;
-	struct mnl_socket *nl;
-	int ret;
-
-	seq = time(NULL);
-	nlh->nlmsg_seq = seq;
-
-	nl = msg_send(NETLINK_GENERIC, nlh);
-	if (!nl)
-		return -ENOTSUP;
-
-	ret = msg_recv(nl, callback, data, seq);
-	mnl_socket_close(nl);
-	return ret;
-}
-
-
-struct nlmsghdr *msg_init(int cmd, int flags)
-{
-	struct genlmsghdr *genl;
-	struct nlmsghdr *nlh;
-
-	nlh = mnl_nlmsg_put_header(buf);
-	if (!nlh)
-		return NULL;
-
-	nlh->nlmsg_type	 = mdio_family;
-	nlh->nlmsg_flags = flags;
-
-	genl = mnl_nlmsg_put_extra_header(nlh, sizeof(struct genlmsghdr));
-	genl->cmd = cmd;
-	genl->version = 1;
-
-	return nlh;
-}
+/* The CLI is single-threaded, and only ever talks to mdio-netlink
+ * through this context, or to the simulation backend. */
+static struct mdio_ctx *ctx;
 
 static int mdio_parse_bus_cb(const char *bus, void *_id)
 {
@@ -176,12 +82,6 @@ err_invalid:
 	return EINVAL;
 }
 
-void mdio_prog_push(struct mdio_prog *prog, struct mdio_nl_insn insn)
-{
-	prog->insns = realloc(prog->insns, (++prog->len) * sizeof(insn));
-	memcpy(&prog->insns[prog->len - 1], &insn, sizeof(insn));
-}
-
 int mdio_parse_range(struct mdio_device *dev, char *str, uint32_t *regs, uint32_t *rege)
 {
 	const char *arg = str;
@@ -375,8 +275,8 @@ int mdio_common_raw_exec(struct mdio_device *dev, int argc, char **argv)
 		err = dev->driver->read(dev, &prog, reg);
 		if (err)
 			return err;
-		mdio_prog_push(&prog, INSN(AND, REG(0), IMM(mask), REG(0)));
-		mdio_prog_push(&prog, INSN(OR,  REG(0), IMM(val),  REG(0)));
+		prog_push(&prog, INSN(AND, REG(0), IMM(mask), REG(0)));
+		prog_push(&prog, INSN(OR,  REG(0), IMM(val),  REG(0)));
 		err = dev->driver->write(dev, &prog, reg, REG(0));
 		if (err)
 			return err;
@@ -388,7 +288,7 @@ int mdio_common_raw_exec(struct mdio_device *dev, int argc, char **argv)
 		err = dev->driver->read(dev, &prog, reg);
 		if (err)
 			return err;
-		mdio_prog_push(&prog, INSN(EMIT,  REG(0),   0,         0));
+		prog_push(&prog, INSN(EMIT,  REG(0),   0,         0));
 	}
 
 	err = mdio_xfer(dev->bus, &prog, cb, NULL);
@@ -401,165 +301,806 @@ int mdio_common_raw_exec(struct mdio_device *dev, int argc, char **argv)
 	return 0;
 }
 
-int mdio_common_bench_cb(uint32_t *data, int len, int err, void *_start)
-{
-	struct timespec end, *start = _start;
+enum mdio_bench_mode {
+	MDIO_BENCH_READ,
+	MDIO_BENCH_WRITE,
+	MDIO_BENCH_RMW,
+};
 
-	clock_gettime(CLOCK_MONOTONIC, &end);
+static const char *mdio_bench_mode_str[] = {
+	[MDIO_BENCH_READ]  = "read",
+	[MDIO_BENCH_WRITE] = "write",
+	[MDIO_BENCH_RMW]   = "rmw",
+};
 
-	if (len) {
-		int i;
+struct mdio_bench {
+	enum mdio_bench_mode mode;
+	uint16_t count;
+	uint16_t workers;
+	bool json;
 
-		printf("Read back %d incorrect values:\n", len);
-		err = 1;
+	/* Time each operation in the kernel, using TIMESTAMP */
+	bool stamps;
 
-		for (i = 0; i < len; i++)
-			printf("\t0x%4.4x\n", data[i]);
-	}
+	/* Only hold the bus lock for one operation at a time, letting
+	 * concurrent workers interleave. */
+	bool sections;
 
-	end.tv_sec -= start->tv_sec;
-	end.tv_nsec -= start->tv_nsec;
-	if (end.tv_nsec < 0) {
-		end.tv_nsec += 1000000000;
-		end.tv_sec--;
-	}
+	uint32_t *regs;
+	uint32_t *expect;
+	int nregs;
 
-	if (err)
-		printf("Benchmark failed after ");
-	else
-		printf("Performed 1000 reads in ");
-
-	if (end.tv_sec)
-		printf("%"PRId64".%2.2"PRId64"s\n", (int64_t)end.tv_sec, (int64_t)end.tv_nsec / 10000000);
-	else if (end.tv_nsec > 1000000)
-		printf("%"PRId64"ms\n", (int64_t)end.tv_nsec / 1000000);
-	else if (end.tv_nsec > 1000)
-		printf("%"PRId64"us\n", (int64_t)end.tv_nsec / 1000);
+	/* Instructions generated by the driver for one pass over all
+	 * registers, excluding those added by the benchmark itself. */
+	int insns;
+
+	/* Output of the benchmark program, possibly spread over
+	 * multiple messages. */
+	uint32_t *data;
+	int len;
+};
+
+/* Outcome of one run of the benchmark program. Passed from workers
+ * to the parent as is, so it must not contain any pointers. */
+struct mdio_bench_result {
+	int err;
+	uint32_t mismatches;
+
+	uint64_t start_ns;
+	uint64_t wall_ns;
+
+	bool has_lat;
+	uint32_t p50, p99, max;
+
+	struct mdio_nl_report report;
+};
+
+static void mdio_bench_print_ns(uint64_t ns)
+{
+	if (ns >= 1000000000)
+		printf("%"PRIu64".%2.2"PRIu64"s", ns / 1000000000,
+		       (ns % 1000000000) / 10000000);
+	else if (ns >= 1000000)
+		printf("%"PRIu64"ms", ns / 1000000);
+	else if (ns >= 1000)
+		printf("%"PRIu64"us", ns / 1000);
 	else
-		printf("%"PRId64"ns\n", (int64_t)end.tv_nsec);
+		printf("%"PRIu64"ns", ns);
+}
+
+static uint64_t mdio_bench_now(void)
+{
+	struct timespec ts;
 
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int mdio_bench_setup_cb(uint32_t *data, int len, int err, void *_bench)
+{
+	struct mdio_bench *bench = _bench;
+
+	if (len != bench->nregs)
+		return 1;
+
+	memcpy(bench->expect, data, len * sizeof(*data));
 	return err;
 }
 
-int mdio_common_bench_exec(struct mdio_device *dev, int argc, char **argv)
+/* Write DATA, if supplied, to all registers, and record the values
+ * they are expected to hold during the run. */
+static int mdio_bench_setup(struct mdio_device *dev, struct mdio_bench *bench,
+			    uint32_t *val)
 {
 	struct mdio_prog prog = MDIO_PROG_EMPTY;
-	struct timespec start;
-	uint32_t reg, val = 0;
-	int err, loop;
+	int err, i;
 
-	err = mdio_device_parse_reg(dev, &argc, &argv, &reg, NULL);
-	if (err)
-		return err;
+	for (i = 0; val && i < bench->nregs; i++) {
+		err = dev->driver->write(dev, &prog, bench->regs[i], IMM(*val));
+		if (err)
+			goto out;
+	}
 
-	if (argv_peek(argc, argv)) {
-		err = mdio_device_parse_val(dev, &argc, &argv, &val, NULL);
+	for (i = 0; i < bench->nregs; i++) {
+		err = dev->driver->read(dev, &prog, bench->regs[i]);
+		if (err)
+			goto out;
+
+		prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
+	}
+
+	err = mdio_xfer(dev->bus, &prog, mdio_bench_setup_cb, bench);
+out:
+	free(prog.insns);
+	return err;
+}
+
+static int mdio_bench_push_op(struct mdio_device *dev, struct mdio_bench *bench,
+			      struct mdio_prog *prog, uint32_t reg,
+			      uint32_t expect)
+{
+	int err, len;
+
+	if (bench->sections)
+		prog_push(prog, INSN(LOCK, 0, 0, 0));
+
+	if (bench->mode != MDIO_BENCH_WRITE) {
+		len = prog->len;
+		err = dev->driver->read(dev, prog, reg);
 		if (err)
 			return err;
 
-		mdio_prog_push(&prog, INSN(ADD, IMM(val), IMM(0), REG(7)));
-		err = dev->driver->write(dev, &prog, reg, REG(7));
+		bench->insns += prog->len - len;
+
+		/* r5 counts unexpected values */
+		prog_push(prog, INSN(JEQ, REG(0), IMM(expect), IMM(1)));
+		prog_push(prog, INSN(ADD, REG(5), IMM(1), REG(5)));
+	}
+
+	if (bench->mode == MDIO_BENCH_RMW) {
+		/* Modify the value that was read, like a real RMW would,
+		 * but leave the register as it was. */
+		len = prog->len;
+		prog_push(prog, INSN(AND, REG(0), IMM(0xfffe), REG(0)));
+		prog_push(prog, INSN(OR,  REG(0), IMM(expect & 1), REG(0)));
+		err = dev->driver->write(dev, prog, reg, REG(0));
 		if (err)
 			return err;
-	} else {
-		err = dev->driver->read(dev, &prog, reg);
+
+		bench->insns += prog->len - len;
+	} else if (bench->mode == MDIO_BENCH_WRITE) {
+		len = prog->len;
+		err = dev->driver->write(dev, prog, reg, IMM(expect));
 		if (err)
 			return err;
 
-		mdio_prog_push(&prog, INSN(ADD, REG(0), IMM(0), REG(7)));
+		bench->insns += prog->len - len;
 	}
 
-	if (argv_peek(argc, argv)) {
-		fprintf(stderr, "ERROR: Unexpected argument");
+	if (bench->sections)
+		prog_push(prog, INSN(UNLOCK, 0, 0, 0));
+
+	/* Outside of the section, so that time spent waiting for
+	 * other workers to release the bus is included. */
+	if (bench->stamps)
+		prog_push(prog, INSN(TIMESTAMP, 0, 0, 0));
+
+	return 0;
+}
+
+static int mdio_bench_build(struct mdio_device *dev, struct mdio_bench *bench,
+			    struct mdio_prog *prog)
+{
+	int err, loop, i;
+
+	prog_push(prog, INSN(ADD, IMM(0), IMM(0), REG(5)));
+	prog_push(prog, INSN(ADD, IMM(0), IMM(0), REG(6)));
+
+	loop = prog->len;
+
+	for (i = 0; i < bench->nregs; i++) {
+		err = mdio_bench_push_op(dev, bench, prog, bench->regs[i],
+					 bench->expect[i]);
+		if (err)
+			return err;
+	}
+
+	prog_push(prog, INSN(ADD, REG(6), IMM(1), REG(6)));
+	prog_push(prog, INSN(JNE, REG(6), IMM(bench->count),
+			     GOTO(prog->len, loop)));
+	prog_push(prog, INSN(EMIT, REG(5), 0, 0));
+	return 0;
+}
+
+static int mdio_bench_cb(uint32_t *data, int len, int err, void *_bench)
+{
+	struct mdio_bench *bench = _bench;
+	uint32_t *all;
+
+	if (!len)
+		return err;
+
+	all = realloc(bench->data, (bench->len + len) * sizeof(*data));
+	if (!all)
+		return 1;
+
+	memcpy(&all[bench->len], data, len * sizeof(*data));
+	bench->data = all;
+	bench->len += len;
+	return err;
+}
+
+static int mdio_bench_u32_cmp(const void *_a, const void *_b)
+{
+	const uint32_t *a = _a, *b = _b;
+
+	return (*a > *b) - (*a < *b);
+}
+
+static void mdio_bench_run(struct mdio_device *dev, struct mdio_bench *bench,
+			   struct mdio_prog *prog, struct mdio_bench_result *res)
+{
+	int ops = bench->count * bench->nregs;
+	uint32_t *lat;
+
+	memset(res, 0, sizeof(*res));
+
+	/* Break down where the time went, if the kernel can tell us */
+	if (mdio_bus_has_flags(dev->bus, MDIO_NL_F_REPORT))
+		prog->report = &res->report;
+
+	res->start_ns = mdio_bench_now();
+	res->err = mdio_xfer_timeout(dev->bus, prog, mdio_bench_cb, bench,
+				     10000);
+	res->wall_ns = mdio_bench_now() - res->start_ns;
+	prog->report = NULL;
+
+	if (res->err) {
+		fprintf(stderr, "ERROR: Bench operation failed (%d)\n",
+			res->err);
+		return;
+	}
+
+	/* One timestamp per operation, if enabled, and the number of
+	 * mismatches. */
+	if (bench->len != (bench->stamps ? ops : 0) + 1) {
+		fprintf(stderr, "ERROR: Unexpected bench output\n");
+		res->err = EIO;
+		return;
+	}
+
+	res->mismatches = bench->data[bench->len - 1];
+
+	if (bench->stamps) {
+		lat = bench->data;
+		qsort(lat, ops, sizeof(*lat), mdio_bench_u32_cmp);
+		res->has_lat = true;
+		res->p50 = lat[(ops - 1) * 50 / 100];
+		res->p99 = lat[(ops - 1) * 99 / 100];
+		res->max = lat[ops - 1];
+	}
+}
+
+static void mdio_bench_print_json(struct mdio_bench *bench,
+				  struct mdio_bench_result *res)
+{
+	uint32_t ops = bench->count * bench->nregs;
+
+	printf("\"ops\":%u,\"wall_ns\":%"PRIu64",\"ops_per_sec\":%.0f,"
+	       "\"mismatches\":%u", ops, res->wall_ns,
+	       ops * 1000000000.0 / res->wall_ns, res->mismatches);
+
+	if (res->has_lat)
+		printf(",\"latency_ns\":{\"p50\":%u,\"p99\":%u,\"max\":%u}",
+		       res->p50, res->p99, res->max);
+
+	if (res->report.insns)
+		printf(",\"kernel\":{\"insns\":%u,\"reads\":%u,"
+		       "\"writes\":%u,\"frames\":%u,\"eval_ns\":%"PRIu64","
+		       "\"lock_ns\":%"PRIu64"}",
+		       res->report.insns, res->report.reads,
+		       res->report.writes, res->report.frames,
+		       (uint64_t)res->report.eval_ns,
+		       (uint64_t)res->report.lock_ns);
+
+	printf(",\"per_op\":{\"insns\":%.2f", (double)bench->insns / bench->nregs);
+	if (res->report.insns)
+		printf(",\"mdio_ops\":%.2f,\"ns\":%.0f",
+		       (double)(res->report.reads + res->report.writes) / ops,
+		       (double)res->report.eval_ns / ops);
+
+	/* Not counted by older versions of mdio-netlink */
+	if (res->report.frames)
+		printf(",\"frames\":%.2f", (double)res->report.frames / ops);
+	putchar('}');
+}
+
+static void mdio_bench_print_lat(struct mdio_bench_result *res)
+{
+	printf("p50 ");
+	mdio_bench_print_ns(res->p50);
+	printf(", p99 ");
+	mdio_bench_print_ns(res->p99);
+	printf(", max ");
+	mdio_bench_print_ns(res->max);
+}
+
+static void mdio_bench_print(struct mdio_bench *bench,
+			     struct mdio_bench_result *res)
+{
+	uint32_t ops = bench->count * bench->nregs;
+
+	if (bench->json) {
+		printf("{\"mode\":\"%s\",\"count\":%u,\"registers\":%d,",
+		       mdio_bench_mode_str[bench->mode], bench->count,
+		       bench->nregs);
+		mdio_bench_print_json(bench, res);
+		puts("}");
+		return;
+	}
+
+	if (res->mismatches)
+		printf("Read back %u incorrect values\n", res->mismatches);
+
+	printf("Performed %u %ss in ", ops, mdio_bench_mode_str[bench->mode]);
+	mdio_bench_print_ns(res->wall_ns);
+	printf(", %.0f ops/s\n", ops * 1000000000.0 / res->wall_ns);
+
+	if (res->has_lat) {
+		printf("Latency: ");
+		mdio_bench_print_lat(res);
+		putchar('\n');
+	}
+
+	if (res->report.insns) {
+		printf("Kernel: %u instructions, %u reads, %u writes, %u frames\n",
+		       res->report.insns, res->report.reads,
+		       res->report.writes, res->report.frames);
+		printf("        %"PRIu64"us executing, of which %"PRIu64"us waiting for the bus lock\n",
+		       (uint64_t)res->report.eval_ns / 1000,
+		       (uint64_t)res->report.lock_ns / 1000);
+	}
+
+	printf("Per %s: %.2f instructions generated", mdio_bench_mode_str[bench->mode],
+	       (double)bench->insns / bench->nregs);
+	if (res->report.insns) {
+		printf(", %.2f MDIO operations, ",
+		       (double)(res->report.reads + res->report.writes) / ops);
+		if (res->report.frames)
+			printf("%.2f frames, ", (double)res->report.frames / ops);
+		mdio_bench_print_ns(res->report.eval_ns / ops);
+	}
+	putchar('\n');
+}
+
+/* Aggregate throughput is measured from the first worker starting to
+ * the last one finishing. Fairness is Jain's index over the
+ * throughput of each worker: 1.0 when all of them got the same
+ * share of the bus, down to 1/N when one of them got all of it. */
+static void mdio_bench_print_workers(struct mdio_bench *bench,
+				     struct mdio_bench_result *res)
+{
+	uint32_t ops = bench->count * bench->nregs;
+	uint64_t first = UINT64_MAX, last = 0;
+	double rate, sum = 0, sqsum = 0;
+	uint32_t mismatches = 0;
+	int i;
+
+	for (i = 0; i < bench->workers; i++) {
+		rate = ops * 1000000000.0 / res[i].wall_ns;
+		sum += rate;
+		sqsum += rate * rate;
+		mismatches += res[i].mismatches;
+
+		if (res[i].start_ns < first)
+			first = res[i].start_ns;
+		if (res[i].start_ns + res[i].wall_ns > last)
+			last = res[i].start_ns + res[i].wall_ns;
+	}
+
+	rate = (double)ops * bench->workers * 1000000000.0 / (last - first);
+
+	if (bench->json) {
+		printf("{\"mode\":\"%s\",\"count\":%u,\"registers\":%d,"
+		       "\"sections\":%s,\"ops\":%u,\"wall_ns\":%"PRIu64","
+		       "\"ops_per_sec\":%.0f,\"fairness\":%.3f,"
+		       "\"mismatches\":%u,\"workers\":[",
+		       mdio_bench_mode_str[bench->mode], bench->count,
+		       bench->nregs, bench->sections ? "true" : "false",
+		       ops * bench->workers, last - first, rate,
+		       sum * sum / (bench->workers * sqsum), mismatches);
+
+		for (i = 0; i < bench->workers; i++) {
+			printf("%s{", i ? "," : "");
+			mdio_bench_print_json(bench, &res[i]);
+			putchar('}');
+		}
+
+		puts("]}");
+		return;
+	}
+
+	for (i = 0; i < bench->workers; i++) {
+		printf("Worker %d: %u %ss in ", i, ops,
+		       mdio_bench_mode_str[bench->mode]);
+		mdio_bench_print_ns(res[i].wall_ns);
+		printf(", %.0f ops/s", ops * 1000000000.0 / res[i].wall_ns);
+
+		if (res[i].has_lat) {
+			printf(", ");
+			mdio_bench_print_lat(&res[i]);
+		}
+
+		if (res[i].report.insns) {
+			printf(", ");
+			mdio_bench_print_ns(res[i].report.lock_ns);
+			printf(" waiting for the bus lock");
+		}
+
+		if (res[i].mismatches)
+			printf(", %u incorrect values", res[i].mismatches);
+
+		putchar('\n');
+	}
+
+	printf("Total: %u %ss in ", ops * bench->workers,
+	       mdio_bench_mode_str[bench->mode]);
+	mdio_bench_print_ns(last - first);
+	printf(", %.0f ops/s, fairness %.3f\n", rate,
+	       sum * sum / (bench->workers * sqsum));
+}
+
+/* Run the program in parallel from multiple processes. Workers are
+ * all forked before any of them starts, and are then released at
+ * once by closing the write end of the shared start pipe. */
+static int mdio_bench_contend(struct mdio_device *dev,
+			      struct mdio_bench *bench, struct mdio_prog *prog,
+			      struct mdio_bench_result *res)
+{
+	int start[2], (*out)[2], i, n, err = 0;
+	struct mdio_bench_result wres;
+	ssize_t len;
+	pid_t *pids;
+	char c;
+
+	pids = calloc(bench->workers, sizeof(*pids));
+	out = calloc(bench->workers, sizeof(*out));
+	if (!pids || !out) {
+		err = ENOMEM;
+		goto free;
+	}
+
+	if (pipe(start)) {
+		err = errno;
+		goto free;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (n = 0; n < bench->workers; n++) {
+		if (pipe(out[n])) {
+			err = errno;
+			break;
+		}
+
+		pids[n] = fork();
+		if (pids[n] < 0) {
+			err = errno;
+			close(out[n][0]);
+			close(out[n][1]);
+			break;
+		}
+
+		if (!pids[n]) {
+			close(start[1]);
+			close(out[n][0]);
+
+			if (read(start[0], &c, 1) < 0)
+				_exit(1);
+
+			mdio_bench_run(dev, bench, prog, &wres);
+			if (write(out[n][1], &wres, sizeof(wres)) != sizeof(wres))
+				_exit(1);
+
+			_exit(0);
+		}
+
+		close(out[n][1]);
+	}
+
+	/* Let the workers loose. If not all of them could be started,
+	 * the ones that were are left to run to completion, but their
+	 * results are discarded. */
+	close(start[0]);
+	close(start[1]);
+
+	for (i = 0; i < n; i++) {
+		len = read(out[i][0], &wres, sizeof(wres));
+		close(out[i][0]);
+		waitpid(pids[i], NULL, 0);
+
+		if (n < bench->workers)
+			continue;
+
+		if (len != sizeof(wres)) {
+			fprintf(stderr, "ERROR: Worker %d did not finish\n", i);
+			err = err ? : EIO;
+			continue;
+		}
+
+		res[i] = wres;
+		err = err ? : res[i].err;
+	}
+
+	if (n < bench->workers)
+		fprintf(stderr, "ERROR: Unable to start worker %d (%d)\n",
+			n, err);
+free:
+	free(out);
+	free(pids);
+	return err;
+}
+
+static int mdio_bench_parse_num(int *argcp, char ***argvp, const char *what,
+				uint16_t *num)
+{
+	unsigned long val;
+	char *arg, *end;
+
+	argv_pop(argcp, argvp);
+	arg = argv_peek(*argcp, *argvp);
+	if (!arg) {
+		fprintf(stderr, "ERROR: Expected %s\n", what);
 		return EINVAL;
 	}
 
+	val = strtoul(arg, &end, 0);
+	if (*end || !val || val > UINT16_MAX) {
+		fprintf(stderr, "ERROR: \"%s\" is not a valid %s [1-%u]\n",
+			arg, what, UINT16_MAX);
+		return EINVAL;
+	}
 
-	mdio_prog_push(&prog, INSN(ADD, IMM(0), IMM(0), REG(6)));
+	*num = val;
+	return 0;
+}
 
-	loop = prog.len;
+static int mdio_bench_parse_opts(struct mdio_bench *bench,
+				 int *argcp, char ***argvp)
+{
+	char *arg;
+	int err, i;
+
+	while ((arg = argv_peek(*argcp, *argvp))) {
+		for (i = 0; i < (int)ARRAY_SIZE(mdio_bench_mode_str); i++)
+			if (!strcmp(arg, mdio_bench_mode_str[i]))
+				break;
+
+		if (i < (int)ARRAY_SIZE(mdio_bench_mode_str)) {
+			bench->mode = i;
+		} else if (!strcmp(arg, "json")) {
+			bench->json = true;
+		} else if (!strcmp(arg, "count")) {
+			err = mdio_bench_parse_num(argcp, argvp, "count",
+						   &bench->count);
+			if (err)
+				return err;
+		} else if (!strcmp(arg, "workers")) {
+			err = mdio_bench_parse_num(argcp, argvp, "number of workers",
+						   &bench->workers);
+			if (err)
+				return err;
+		} else {
+			break;
+		}
+
+		argv_pop(argcp, argvp);
+	}
+
+	return 0;
+}
+
+/* REG[,REG...] */
+static int mdio_bench_parse_regs(struct mdio_device *dev,
+				 struct mdio_bench *bench,
+				 int *argcp, char ***argvp)
+{
+	char *str = argv_pop(argcp, argvp);
+	char *tok, *save;
+	uint32_t *regs;
+	int err, argc;
+	char **argv;
+
+	if (!str) {
+		fprintf(stderr, "ERROR: Expected register\n");
+		return EINVAL;
+	}
+
+	for (tok = strtok_r(str, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		regs = realloc(bench->regs, (bench->nregs + 1) * sizeof(*regs));
+		if (!regs)
+			return ENOMEM;
+
+		bench->regs = regs;
 
-	err = dev->driver->read(dev, &prog, reg);
+		argc = 1;
+		argv = &tok;
+		err = mdio_device_parse_reg(dev, &argc, &argv,
+					    &bench->regs[bench->nregs], NULL);
+		if (err)
+			return err;
+
+		bench->nregs++;
+	}
+
+	return bench->nregs ? 0 : EINVAL;
+}
+
+int mdio_common_bench_exec(struct mdio_device *dev, int argc, char **argv)
+{
+	struct mdio_bench bench = {
+		.mode = MDIO_BENCH_READ,
+		.count = 1000,
+		.workers = 1,
+	};
+	struct mdio_prog prog = MDIO_PROG_EMPTY;
+	struct mdio_bench_result *res = NULL;
+	bool has_val = false;
+	uint32_t val;
+	int err, i;
+
+	err = mdio_bench_parse_opts(&bench, &argc, &argv);
 	if (err)
 		return err;
 
-	mdio_prog_push(&prog, INSN(JEQ, REG(0), REG(7), IMM(1)));
-	mdio_prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
-	mdio_prog_push(&prog, INSN(ADD, REG(6), IMM(1), REG(6)));
-	mdio_prog_push(&prog, INSN(JNE, REG(6), IMM(1000), GOTO(prog.len, loop)));
+	err = mdio_bench_parse_regs(dev, &bench, &argc, &argv);
+	if (err)
+		goto out;
 
-	clock_gettime(CLOCK_MONOTONIC, &start);
-	err = mdio_xfer_timeout(dev->bus, &prog, mdio_common_bench_cb, &start, 10000);
-	free(prog.insns);
+	if (argv_peek(argc, argv)) {
+		err = mdio_device_parse_val(dev, &argc, &argv, &val, NULL);
+		if (err)
+			goto out;
+
+		has_val = true;
+	}
+
+	if (argv_peek(argc, argv)) {
+		fprintf(stderr, "ERROR: Unexpected argument\n");
+		err = EINVAL;
+		goto out;
+	}
+
+	bench.expect = calloc(bench.nregs, sizeof(*bench.expect));
+	res = calloc(bench.workers, sizeof(*res));
+	if (!bench.expect || !res) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mdio_bench_setup(dev, &bench, has_val ? &val : NULL);
 	if (err) {
-		fprintf(stderr, "ERROR: Bench operation failed (%d)\n", err);
-		return 1;
+		fprintf(stderr, "ERROR: Bench setup failed (%d)\n", err);
+		goto out;
 	}
 
-	return 0;
+	bench.stamps = mdio_bus_supports(dev->bus, MDIO_NL_OP_TIMESTAMP);
+	bench.sections = bench.workers > 1 &&
+		mdio_bus_supports(dev->bus, MDIO_NL_OP_LOCK);
+
+	err = mdio_bench_build(dev, &bench, &prog);
+	if (err)
+		goto out;
+
+	if (bench.workers > 1) {
+		err = mdio_bench_contend(dev, &bench, &prog, res);
+		if (err)
+			goto out;
+
+		mdio_bench_print_workers(&bench, res);
+	} else {
+		mdio_bench_run(dev, &bench, &prog, res);
+		err = res->err;
+		if (err)
+			goto out;
+
+		mdio_bench_print(&bench, res);
+	}
+
+	for (i = 0; i < bench.workers; i++)
+		if (res[i].mismatches)
+			err = 1;
+out:
+	free(res);
+	free(prog.insns);
+	free(bench.regs);
+	free(bench.expect);
+	free(bench.data);
+	return err ? 1 : 0;
 }
 
-int mdio_common_dump_cb(uint32_t *data, int len, int err, void *_range)
-{
-	struct reg_range *range = _range;
+struct mdio_dump {
+	struct reg_range range;
+
+	/* Next register to be reported */
 	uint32_t reg;
 
-	if (len != (int)(range->end - range->start + 1))
+	/* Number of registers that could not be read */
+	int errors;
+};
+
+/* Large dumps arrive over multiple calls, the caller checks that the
+ * whole range was covered once the transfer is done. */
+int mdio_common_dump_cb(uint32_t *data, int len, int err, void *_dump)
+{
+	struct mdio_dump *dump = _dump;
+	int i;
+
+	if (len > (int)(dump->range.end + 1 - dump->reg))
 		return 1;
 
-	for (reg = range->start; reg <= range->end; reg++)
-		printf("0x%04x: 0x%04x\n", reg, *data++);
+	for (i = 0; i < len; i++, dump->reg++) {
+		if (data[i] & MDIO_NL_DATA_ERR) {
+			printf("0x%04x: error (%s)\n", dump->reg,
+			       strerror(MDIO_NL_DATA_ERRNO(data[i])));
+			dump->errors++;
+		} else {
+			printf("0x%04x: 0x%04x\n", dump->reg, data[i]);
+		}
+	}
 
 	return err;
 }
 
-int mdio_common_dump_exec_one(struct mdio_device *dev, int *argc, char ***argv)
+int mdio_common_dump_exec_one(struct mdio_device *dev, int *argc, char ***argv,
+			      int *errors)
 {
 	struct mdio_prog prog = MDIO_PROG_EMPTY;
-	struct reg_range range;
+	struct mdio_dump dump = { .errors = 0 };
+	struct reg_range *range = &dump.range;
 	uint32_t reg;
 	int err;
 
-	err = mdio_device_parse_reg(dev, argc, argv, &range.start, &range.end);
+	/* Report unreadable registers instead of failing the whole dump */
+	if (dev->driver->nonfatal &&
+	    mdio_bus_has_flags(dev->bus, MDIO_NL_F_NONFATAL))
+		prog.flags = MDIO_NL_F_NONFATAL;
+
+	err = mdio_device_parse_reg(dev, argc, argv, &range->start, &range->end);
 	if (err)
 		return err;
 
 	if(dev->driver->dump) {
-		err = dev->driver->dump(dev, &prog, &range);
+		err = dev->driver->dump(dev, &prog, range);
 		if (err)
 			return err;
 	} else {
 		/* Can't emit a loop, since there's no way to pass the (mdio)
 		* register in a (mdio-netlink) register - so we unroll it. */
-		for (reg = range.start; reg <= range.end; reg++) {
+		for (reg = range->start; reg <= range->end; reg++) {
 			err = dev->driver->read(dev, &prog, reg);
 			if (err)
 				return err;
 
-			mdio_prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
+			prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
 		}
  }
 
-	err = mdio_xfer_timeout(dev->bus, &prog, mdio_common_dump_cb, &range, 10000);
+	dump.reg = range->start;
+	err = mdio_xfer_timeout(dev->bus, &prog, mdio_common_dump_cb, &dump, 10000);
 	free(prog.insns);
+	if (!err && dump.reg != range->end + 1)
+		err = 1;
+
 	if (err) {
 		fprintf(stderr, "ERROR: Dump operation failed (%d)\n", err);
 		return 1;
 	}
 
+	*errors += dump.errors;
 	return 0;
 }
 
 int mdio_common_dump_exec(struct mdio_device *dev, int argc, char **argv)
 {
-	int err;
+	int err, errors = 0;
 
 	while (argv_peek(argc, argv)) {
-		err = mdio_common_dump_exec_one(dev, &argc, &argv);
+		err = mdio_common_dump_exec_one(dev, &argc, &argv, &errors);
 		if (err)
 			return err;
 	}
 
+	/* In non-fatal mode, the remaining ranges are still dumped,
+	 * but the dump as a whole has failed. */
+	if (errors) {
+		fprintf(stderr, "ERROR: %d register%s could not be read\n",
+			errors, errors == 1 ? "" : "s");
+		return 1;
+	}
+
 	return 0;
 }
 
@@ -583,58 +1124,27 @@ int mdio_common_exec(struct mdio_device *dev, int argc, char **argv)
 }
 
 
-
-struct mdio_xfer_data {
-	mdio_xfer_cb_t cb;
-	void *arg;
-	int err;
-};
-
-static int mdio_xfer_cb(const struct nlmsghdr *nlh, void *_xfer)
+void prog_push(struct mdio_prog *prog, struct mdio_nl_insn insn)
 {
-	struct genlmsghdr *genl = mnl_nlmsg_get_payload(nlh);
-	struct nlattr *tb[MDIO_NLA_MAX + 1] = {};
-	struct mdio_xfer_data *xfer = _xfer;
-	uint32_t *data;
-	int len, err;
-
-	mnl_attr_parse(nlh, sizeof(*genl), parse_attrs, tb);
-
-	if (tb[MDIO_NLA_ERROR])
-		xfer->err = (int)mnl_attr_get_u32(tb[MDIO_NLA_ERROR]);
-
-	if (!tb[MDIO_NLA_DATA])
-		return MNL_CB_ERROR;
+	if (mdio_prog_push(prog, insn)) {
+		fprintf(stderr, "ERROR: Unable to grow program\n");
+		exit(1);
+	}
+}
 
-	len = mnl_attr_get_payload_len(tb[MDIO_NLA_DATA]) / sizeof(uint32_t);
-	data = mnl_attr_get_payload(tb[MDIO_NLA_DATA]);
+int mdio_xfer_timeout_us(const char *bus, struct mdio_prog *prog,
+			 mdio_xfer_cb_t cb, void *arg, uint32_t timeout_us)
+{
+	if (mdio_sim_enabled())
+		return mdio_sim_xfer(bus, prog, cb, arg, timeout_us);
 
-	err = xfer->cb(data, len, xfer->err, xfer->arg);
-	return err ? MNL_CB_ERROR : MNL_CB_OK;
+	return mdio_ctx_xfer(ctx, bus, prog, cb, arg, timeout_us);
 }
 
 int mdio_xfer_timeout(const char *bus, struct mdio_prog *prog,
 		      mdio_xfer_cb_t cb, void *arg, uint16_t timeout_ms)
 {
-	struct mdio_xfer_data xfer = { .cb = cb, .arg = arg };
-	struct nlmsghdr *nlh;
-	int err;
-
-	if (prog->len * sizeof(*prog->insns) > len)
-		return -ENOMEM;
-
-	nlh = msg_init(MDIO_GENL_XFER, NLM_F_REQUEST | NLM_F_ACK);
-	if (!nlh)
-		return -ENOMEM;
-
-	mnl_attr_put_strz(nlh, MDIO_NLA_BUS_ID, bus);
-	mnl_attr_put(nlh, MDIO_NLA_PROG, prog->len * sizeof(*prog->insns),
-		     prog->insns);
-
-	mnl_attr_put_u16(nlh, MDIO_NLA_TIMEOUT, timeout_ms);
-
-	err = msg_query(nlh, mdio_xfer_cb, &xfer);
-	return xfer.err ? : err;
+	return mdio_xfer_timeout_us(bus, prog, cb, arg, timeout_ms * 1000);
 }
 
 int mdio_xfer(const char *bus, struct mdio_prog *prog,
@@ -643,78 +1153,89 @@ int mdio_xfer(const char *bus, struct mdio_prog *prog,
 	return mdio_xfer_timeout(bus, prog, cb, arg, 1000);
 }
 
-int mdio_for_each(const char *match,
-		  int (*cb)(const char *bus, void *arg), void *arg)
+int mdio_read_list(const char *bus, const struct mdio_nl_reg *regs, int n,
+		   uint32_t flags, mdio_xfer_cb_t cb, void *arg)
 {
-	char gmatch[0x80];
-	glob_t gl;
-	size_t i;
-	int err;
+	if (mdio_sim_enabled())
+		return mdio_sim_read_list(bus, regs, n, flags, cb, arg);
 
-	snprintf(gmatch, sizeof(gmatch), "/sys/class/mdio_bus/%s", match);
-	glob(gmatch, 0, NULL, &gl);
+	return mdio_ctx_read_list(ctx, bus, regs, n, flags, cb, arg);
+}
 
-	for (err = 0, i = 0; i < gl.gl_pathc; i++) {
-		err = cb(&gl.gl_pathv[i][strlen("/sys/class/mdio_bus/")], arg);
-		if (err)
-			break;
-	}
+int mdio_write_list(const char *bus, const struct mdio_nl_write *writes,
+		    int n, bool verify, mdio_xfer_cb_t cb, void *arg)
+{
+	if (mdio_sim_enabled())
+		return mdio_sim_write_list(bus, writes, n, verify, cb, arg);
 
-	globfree(&gl);
-	return err;
+	return mdio_ctx_write_list(ctx, bus, writes, n, verify, cb, arg);
 }
 
+int mdio_rate_get(const char *bus, struct mdio_rate *rate)
+{
+	if (mdio_sim_enabled())
+		return -EOPNOTSUPP;
 
-static int family_id_cb(const struct nlmsghdr *nlh, void *_null)
+	return mdio_ctx_rate_get(ctx, bus, rate);
+}
+
+int mdio_rate_set(const char *bus, struct mdio_rate *rate)
 {
-	struct genlmsghdr *genl = mnl_nlmsg_get_payload(nlh);
-	struct nlattr *tb[CTRL_ATTR_MAX + 1] = {};
+	if (mdio_sim_enabled())
+		return -EOPNOTSUPP;
 
-	mnl_attr_parse(nlh, sizeof(*genl), parse_attrs, tb);
-	if (!tb[CTRL_ATTR_FAMILY_ID])
-		return MNL_CB_ERROR;
+	return mdio_ctx_rate_set(ctx, bus, rate);
+}
+
+int mdio_bus_info(const char *bus, struct mdio_bus_info *info)
+{
+	if (mdio_sim_enabled())
+		return mdio_sim_bus_info(bus, info);
 
-	mdio_family = mnl_attr_get_u16(tb[CTRL_ATTR_FAMILY_ID]);
-	return MNL_CB_OK;
+	return mdio_ctx_bus_info(ctx, bus, info);
 }
 
-int mdio_modprobe(void)
+bool mdio_bus_supports(const char *bus, enum mdio_nl_op op)
 {
-	int wstatus;
-	pid_t pid;
+	struct mdio_bus_info info;
 
-	pid = fork();
-	if (pid < 0) {
-		return -errno;
-	} else if (!pid) {
-		execl("/sbin/modprobe", "modprobe", "mdio-netlink", NULL);
-		exit(1);
-	}
+	if (mdio_sim_enabled())
+		return !mdio_sim_bus_info(bus, &info) && (info.isa & BIT(op));
 
-	if (waitpid(pid, &wstatus, 0) <= 0)
-		return -ECHILD;
+	return mdio_ctx_bus_supports(ctx, bus, op);
+}
 
-	if (WIFEXITED(wstatus) && !WEXITSTATUS(wstatus))
-		return 0;
+bool mdio_bus_has_flags(const char *bus, uint32_t flags)
+{
+	struct mdio_bus_info info;
 
-	return -EPERM;
+	if (mdio_sim_enabled())
+		return !mdio_sim_bus_info(bus, &info) &&
+			(info.flags & flags) == flags;
+
+	return mdio_ctx_bus_has_flags(ctx, bus, flags);
 }
 
-int mdio_init(void)
+int mdio_for_each(const char *match,
+		  int (*cb)(const char *bus, void *arg), void *arg)
 {
-	struct genlmsghdr *genl;
-	struct nlmsghdr *nlh;
+	if (mdio_sim_enabled())
+		return mdio_sim_for_each(match, cb, arg);
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type	= GENL_ID_CTRL;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	return mdio_ctx_for_each(ctx, match, cb, arg);
+}
 
-	genl = mnl_nlmsg_put_extra_header(nlh, sizeof(struct genlmsghdr));
-	genl->cmd = CTRL_CMD_GETFAMILY;
-	genl->version = 1;
+int mdio_bus_monitor(int (*cb)(const struct mdio_bus_info *info,
+			       bool added, void *arg), void *arg)
+{
+	if (mdio_sim_enabled())
+		return -ENOTSUP;
 
-	mnl_attr_put_u16(nlh, CTRL_ATTR_FAMILY_ID, GENL_ID_CTRL);
-	mnl_attr_put_strz(nlh, CTRL_ATTR_FAMILY_NAME, "mdio");
+	return mdio_ctx_bus_monitor(ctx, cb, arg);
+}
 
-	return msg_query(nlh, family_id_cb, NULL);
+int mdio_init(void)
+{
+	ctx = mdio_ctx_new();
+	return ctx ? 0 : -errno;
 }
@@ -1,11 +1,13 @@
-#ifndef _LIBMDIO_H
-#define _LIBMDIO_H
+#ifndef _MDIO_H
+#define _MDIO_H
 
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <linux/mdio-netlink.h>
 
+#include "libmdio.h"
+
 #define BIT(_n) (1 << (_n))
 
 #define ARRAY_SIZE(_a) (sizeof(_a) / sizeof((_a)[0]))
@@ -16,19 +18,16 @@
 
 #define MDIO_DEV_MAX 32
 
-#define REG(_r) ((MDIO_NL_ARG_REG << 16) | ((uint16_t)(_r)))
-#define IMM(_n) ((MDIO_NL_ARG_IMM << 16) | ((uint16_t)(_n)))
+#define REG(_r) MDIO_REG(_r)
+#define IMM(_n) MDIO_IMM(_n)
 #define INVALID 0
-#define GOTO(_from, _to) ((MDIO_NL_ARG_IMM << 16) | ((uint16_t)((_to) - (_from) - 1)))
+#define GOTO(_from, _to) MDIO_GOTO(_from, _to)
+
+#define INSN(_op, _a0, _a1, _a2) MDIO_INSN(_op, _a0, _a1, _a2)
 
-#define INSN(_op, _a0, _a1, _a2)		\
-	((struct mdio_nl_insn)			\
-	{					\
-		.op = MDIO_NL_OP_ ## _op,	\
-		.arg0 = _a0,			\
-		.arg1 = _a1,			\
-		.arg2 = _a2			\
-	})
+/* Like mdio_prog_push(), but exits if the program can not be grown,
+ * sparing each step of every program generator from checking. */
+void prog_push(struct mdio_prog *prog, struct mdio_nl_insn insn);
 
 static inline char *argv_peek(int argc, char **argv)
 {
@@ -91,22 +90,6 @@ struct reg_range {
 	uint32_t end;
 };
 
-struct mdio_prog {
-	struct mdio_nl_insn *insns;
-	int len;
-};
-#define MDIO_PROG_EMPTY ((struct mdio_prog) { 0 })
-#define MDIO_PROG_FIXED(_insns)			\
-	((struct mdio_prog)			\
-	{					\
-		.insns = _insns,		\
-		.len = ARRAY_SIZE(_insns)	\
-	})
-
-void mdio_prog_push(struct mdio_prog *prog, struct mdio_nl_insn insn);
-
-typedef int (*mdio_xfer_cb_t)(uint32_t *data, int len, int err, void *arg);
-
 struct mdio_ops {
 	char *bus;
 
@@ -120,16 +103,44 @@ struct mdio_ops {
 
 int mdio_raw_exec (struct mdio_ops *ops, int argc, char **argv);
 
+int mdio_xfer_timeout_us(const char *bus, struct mdio_prog *prog,
+			 mdio_xfer_cb_t cb, void *arg, uint32_t timeout_us);
 int mdio_xfer_timeout(const char *bus, struct mdio_prog *prog,
 		      mdio_xfer_cb_t cb, void *arg, uint16_t timeout_ms);
 int mdio_xfer(const char *bus, struct mdio_prog *prog,
 	      mdio_xfer_cb_t cb, void *arg);
+int mdio_read_list(const char *bus, const struct mdio_nl_reg *regs, int n,
+		   uint32_t flags, mdio_xfer_cb_t cb, void *arg);
+int mdio_write_list(const char *bus, const struct mdio_nl_write *writes,
+		    int n, bool verify, mdio_xfer_cb_t cb, void *arg);
+
+int mdio_rate_get(const char *bus, struct mdio_rate *rate);
+int mdio_rate_set(const char *bus, struct mdio_rate *rate);
+
+int mdio_bus_info(const char *bus, struct mdio_bus_info *info);
+bool mdio_bus_supports(const char *bus, enum mdio_nl_op op);
+bool mdio_bus_has_flags(const char *bus, uint32_t flags);
+int mdio_bus_monitor(int (*cb)(const struct mdio_bus_info *info,
+			       bool added, void *arg), void *arg);
 
 int mdio_for_each(const char *match,
 		  int (*cb)(const char *bus, void *arg), void *arg);
-int mdio_modprobe(void);
 int mdio_init(void);
 
+int mdio_sim_load(FILE *fp, const char *name);
+int mdio_sim_init(const char *path);
+void mdio_sim_exit(void);
+bool mdio_sim_enabled(void);
+int mdio_sim_xfer(const char *bus, struct mdio_prog *prog,
+		  mdio_xfer_cb_t cb, void *arg, uint32_t timeout_us);
+int mdio_sim_read_list(const char *bus, const struct mdio_nl_reg *regs, int n,
+		       uint32_t flags, mdio_xfer_cb_t cb, void *arg);
+int mdio_sim_write_list(const char *bus, const struct mdio_nl_write *writes,
+			int n, bool verify, mdio_xfer_cb_t cb, void *arg);
+int mdio_sim_bus_info(const char *bus, struct mdio_bus_info *info);
+int mdio_sim_for_each(const char *match,
+		      int (*cb)(const char *bus, void *arg), void *arg);
+
 struct mdio_driver;
 
 struct mdio_device {
@@ -157,6 +168,11 @@ struct mdio_driver {
 			 uint32_t *regs, uint32_t *rege);
 	int (*parse_val)(struct mdio_device *dev, int *argcp, char ***argvp,
 			 uint32_t *val, uint32_t *mask);
+
+	/* Set if the driver's dumps may run in MDIO_NL_F_NONFATAL
+	 * mode, i.e. if they never act on a value read from the bus,
+	 * which is all-ones for registers that could not be read. */
+	bool nonfatal;
 };
 
 int mdio_parse_range(struct mdio_device *dev, char *str, uint32_t *regs, uint32_t *rege);
@@ -165,8 +181,9 @@ int mdio_common_exec(struct mdio_device *dev, int argc, char **argv);
 
 int bus_status(const char *bus);
 int bus_list(void);
+int bus_monitor(void);
 
 int phy_exec(const char *bus, int argc, char **argv);
 int mmd_exec(const char *bus, int argc, char **argv);
 
-#endif	/* _LIBMDIO_H */
+#endif	/* _MDIO_H */
@@ -44,10 +44,10 @@ static void mvls_wait_cmd(struct mdio_prog *prog, uint8_t id)
 	int retry;
 
 	retry = prog->len;
-	mdio_prog_push(prog, INSN(READ, IMM(id), IMM(MVLS_CMD), REG(0)));
-	mdio_prog_push(prog, INSN(AND, REG(0), IMM(MVLS_CMD_BUSY), REG(0)));
-	mdio_prog_push(prog, INSN(JEQ, REG(0), IMM(MVLS_CMD_BUSY),
-				  GOTO(prog->len, retry)));
+	prog_push(prog, INSN(READ, IMM(id), IMM(MVLS_CMD), REG(0)));
+	prog_push(prog, INSN(AND, REG(0), IMM(MVLS_CMD_BUSY), REG(0)));
+	prog_push(prog, INSN(JEQ, REG(0), IMM(MVLS_CMD_BUSY),
+			     GOTO(prog->len, retry)));
 }
 
 static void mvls_read_to(struct mdio_device *dev, struct mdio_prog *prog,
@@ -62,14 +62,14 @@ static void mvls_read_to(struct mdio_device *dev, struct mdio_prog *prog,
 	if (!mdev->id) {
 		/* Single-chip addressing, the switch uses the entire
 		 * underlying bus */
-		mdio_prog_push(prog, INSN(READ, IMM(port), IMM(reg), REG(to)));
+		prog_push(prog, INSN(READ, IMM(port), IMM(reg), REG(to)));
 		return;
 	}
 
-	mdio_prog_push(prog, INSN(WRITE, IMM(mdev->id), IMM(MVLS_CMD),
-				  IMM(mvls_multi_cmd(port, reg, false))));
+	prog_push(prog, INSN(WRITE, IMM(mdev->id), IMM(MVLS_CMD),
+			     IMM(mvls_multi_cmd(port, reg, false))));
 	mvls_wait_cmd(prog, mdev->id);
-	mdio_prog_push(prog, INSN(READ, IMM(mdev->id), IMM(MVLS_DATA), REG(to)));
+	prog_push(prog, INSN(READ, IMM(mdev->id), IMM(MVLS_DATA), REG(to)));
 }
 
 static int mvls_read(struct mdio_device *dev, struct mdio_prog *prog,
@@ -91,13 +91,13 @@ static int mvls_write(struct mdio_device *dev, struct mdio_prog *prog,
 	if (!mdev->id) {
 		/* Single-chip addressing, the switch uses the entire
 		 * underlying bus */
-		mdio_prog_push(prog, INSN(WRITE, IMM(port), IMM(reg), val));
+		prog_push(prog, INSN(WRITE, IMM(port), IMM(reg), val));
 		return 0;
 	}
 
-	mdio_prog_push(prog, INSN(WRITE, IMM(mdev->id), IMM(MVLS_DATA), val));
-	mdio_prog_push(prog, INSN(WRITE, IMM(mdev->id), IMM(MVLS_CMD),
-				  IMM(mvls_multi_cmd(port, reg, true))));
+	prog_push(prog, INSN(WRITE, IMM(mdev->id), IMM(MVLS_DATA), val));
+	prog_push(prog, INSN(WRITE, IMM(mdev->id), IMM(MVLS_CMD),
+			     IMM(mvls_multi_cmd(port, reg, true))));
 	mvls_wait_cmd(prog, mdev->id);
 	return 0;
 }
@@ -108,9 +108,9 @@ static void mvls_wait(struct mdio_device *dev, struct mdio_prog *prog,
 	int retry = prog->len;
 
 	mvls_read_to(dev, prog, reg, 0);
-	mdio_prog_push(prog, INSN(AND, REG(0), IMM(MVLS_CMD_BUSY), REG(0)));
-	mdio_prog_push(prog, INSN(JEQ, REG(0), IMM(MVLS_CMD_BUSY),
-				  GOTO(prog->len, retry)));
+	prog_push(prog, INSN(AND, REG(0), IMM(MVLS_CMD_BUSY), REG(0)));
+	prog_push(prog, INSN(JEQ, REG(0), IMM(MVLS_CMD_BUSY),
+			     GOTO(prog->len, retry)));
 }
 
 int mvls_id_cb(uint32_t *data, int len, int err, void *_id)
@@ -131,7 +131,7 @@ static uint32_t mvls_id_exec(struct mdio_device *dev)
 	int err;
 
 	mvls_read(dev, &prog, MVLS_REG(0x10, 0x03));
-	mdio_prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
+	prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
 
 	err = mdio_xfer(dev->bus, &prog, mvls_id_cb, &id);
 	free(prog.insns);
@@ -221,7 +221,7 @@ static int mvls_lag_exec(struct mdio_device *dev, int argc, char **argv)
 	for (i = 0; i < 16; i++) {
 		mvls_write(dev, &prog, MVLS_REG(MVLS_G2, 0x08), IMM(i << 11));
 		mvls_read(dev, &prog, MVLS_REG(MVLS_G2, 0x08));
-		mdio_prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
+		prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
 	}
 
 	for (i = 0; i < 8; i++) {
@@ -229,12 +229,12 @@ static int mvls_lag_exec(struct mdio_device *dev, int argc, char **argv)
 
 		/* Keep the current value of the HashTrunk bit when
 		 * selecting the mask to read out. */
-		mdio_prog_push(&prog, INSN(AND, REG(0), IMM(1 << 11), REG(0)));
-		mdio_prog_push(&prog, INSN(OR, REG(0), IMM(i << 12), REG(0)));
+		prog_push(&prog, INSN(AND, REG(0), IMM(1 << 11), REG(0)));
+		prog_push(&prog, INSN(OR, REG(0), IMM(i << 12), REG(0)));
 
 		mvls_write(dev, &prog, MVLS_REG(MVLS_G2, 0x07), REG(0));
 		mvls_read(dev, &prog, MVLS_REG(MVLS_G2, 0x07));
-		mdio_prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
+		prog_push(&prog, INSN(EMIT, REG(0), 0, 0));
 	}
 
 	err = mdio_xfer(dev->bus, &prog, mvls_lag_cb, NULL);
@@ -289,9 +289,9 @@ static void mvls_counter_read_one(struct mdio_device *dev, struct mdio_prog *pro
 	mvls_wait(dev, prog, MVLS_REG(MVLS_G1, 0x1d));
 
 	mvls_read(dev, prog, MVLS_REG(MVLS_G1, 0x1e));
-	mdio_prog_push(prog, INSN(EMIT, REG(0), 0, 0));
+	prog_push(prog, INSN(EMIT, REG(0), 0, 0));
 	mvls_read(dev, prog, MVLS_REG(MVLS_G1, 0x1f));
-	mdio_prog_push(prog, INSN(EMIT, REG(0), 0, 0));
+	prog_push(prog, INSN(EMIT, REG(0), 0, 0));
 
 }
 
@@ -331,7 +331,7 @@ static int mvls_counter_exec(struct mdio_device *dev, int argc, char **argv)
 
 	mvls_wait(dev, &prog, MVLS_REG(MVLS_G1, 0x1d));
 
-	mdio_prog_push(&prog, INSN(ADD, IMM((1 << 15) | (5 << 12) | base), IMM(0), REG(1)));
+	prog_push(&prog, INSN(ADD, IMM((1 << 15) | (5 << 12) | base), IMM(0), REG(1)));
 
 	loop = prog.len;
 
@@ -346,10 +346,10 @@ static int mvls_counter_exec(struct mdio_device *dev, int argc, char **argv)
 	mvls_counter_read_one(dev, &prog, 0x13);
 	mvls_counter_read_one(dev, &prog, 0x12);
 
-	mdio_prog_push(&prog, INSN(ADD, REG(1), IMM(shift), REG(1)));
-	mdio_prog_push(&prog, INSN(JNE, REG(1),
-				   IMM((1 << 15) | (5 << 12) | (base + (shift * 11))),
-				   GOTO(prog.len, loop)));
+	prog_push(&prog, INSN(ADD, REG(1), IMM(shift), REG(1)));
+	prog_push(&prog, INSN(JNE, REG(1),
+			      IMM((1 << 15) | (5 << 12) | (base + (shift * 11))),
+			      GOTO(prog.len, loop)));
 
 	while (!(err = mdio_xfer(dev->bus, &prog, mvls_counter_cb, &ctx))) {
 		if (repeat) {
@@ -408,8 +408,8 @@ static int mvls_atu_exec(struct mdio_device *dev, int argc, char **argv)
 
 			/* Limit to specific FID */
 			mvls_read_to(dev, &prog, MVLS_REG(MVLS_G1, 0x01), 0);
-			mdio_prog_push(&prog, INSN(AND, REG(0), IMM(0xf0000), REG(0)));
-			mdio_prog_push(&prog, INSN(OR, REG(0), IMM(fid & 0xfff), REG(0)));
+			prog_push(&prog, INSN(AND, REG(0), IMM(0xf0000), REG(0)));
+			prog_push(&prog, INSN(OR, REG(0), IMM(fid & 0xfff), REG(0)));
 			mvls_write(dev, &prog, MVLS_REG(MVLS_G1, 0x01), REG(0));
 			op = 4;
 		}
@@ -432,8 +432,8 @@ exec:
 	mvls_wait(dev, &prog, MVLS_REG(MVLS_G1, 0x0b));
 
 	mvls_read_to(dev, &prog, MVLS_REG(MVLS_G1, 0x0b), 0);
-	mdio_prog_push(&prog, INSN(AND, REG(0), IMM(0xfff), REG(0)));
-	mdio_prog_push(&prog, INSN(OR, REG(0), IMM(BIT(15) | (op << 12)), REG(0)));
+	prog_push(&prog, INSN(AND, REG(0), IMM(0xfff), REG(0)));
+	prog_push(&prog, INSN(OR, REG(0), IMM(BIT(15) | (op << 12)), REG(0)));
 	mvls_write(dev, &prog, MVLS_REG(MVLS_G1, 0x0b), REG(0));
 
 	mvls_wait(dev, &prog, MVLS_REG(MVLS_G1, 0x0b));
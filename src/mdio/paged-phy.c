@@ -19,6 +19,19 @@ struct pphy_device {
 	const struct pphy_page_name *page_names;
 };
 
+/* Let the kernel manage the page register if it can, in which case
+ * the page is only written when it changes and is restored once,
+ * at the end of the program. */
+static bool pphy_page(struct pphy_device *pdev, struct mdio_prog *prog,
+		      uint8_t page)
+{
+	if (!mdio_bus_supports(pdev->dev.bus, MDIO_NL_OP_PAGE))
+		return false;
+
+	prog_push(prog, INSN(PAGE,  IMM(pdev->id), IMM(pdev->page_reg),  IMM(page)));
+	return true;
+}
+
 int pphy_read(struct mdio_device *dev, struct mdio_prog *prog, uint32_t reg)
 {
 	struct pphy_device *pdev = (void *)dev;
@@ -27,16 +40,21 @@ int pphy_read(struct mdio_device *dev, struct mdio_prog *prog, uint32_t reg)
 	page = reg >> 16;
 	reg &= 0x1f;
 
+	if (pphy_page(pdev, prog, page)) {
+		prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(reg),  REG(0)));
+		return 0;
+	}
+
 	/* Save current page in R1 and write the requested one, if they differ. */
-	mdio_prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
-	mdio_prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
-	mdio_prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  IMM(page)));
+	prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
+	prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
+	prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  IMM(page)));
 
-	mdio_prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(reg),  REG(0)));
+	prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(reg),  REG(0)));
 
 	/* Restore old page if we changed it. */
-	mdio_prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
-	mdio_prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
+	prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
+	prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
 	return 0;
 }
 
@@ -49,16 +67,21 @@ int pphy_write(struct mdio_device *dev, struct mdio_prog *prog,
 	page = reg >> 16;
 	reg &= 0x1f;
 
+	if (pphy_page(pdev, prog, page)) {
+		prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(reg),  val));
+		return 0;
+	}
+
 	/* Save current page in R1 and write the requested one, if they differ. */
-	mdio_prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
-	mdio_prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
-	mdio_prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  IMM(page)));
+	prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
+	prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
+	prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  IMM(page)));
 
-	mdio_prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(reg),  val));
+	prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(reg),  val));
 
 	/* Restore old page if we changed it. */
-	mdio_prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
-	mdio_prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
+	prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
+	prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
 	return 0;
 }
 
@@ -133,19 +156,28 @@ int pphy_dump(struct mdio_device *dev, struct mdio_prog *prog,
 	page = range->start >> 16;
 	range->start &= 0x1f;
 
+	if (pphy_page(pdev, prog, page)) {
+		for (reg = range->start; reg <= range->end; reg++) {
+			prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(reg),  REG(0)));
+			prog_push(prog, INSN(EMIT, REG(0), 0, 0));
+		}
+
+		return 0;
+	}
+
 	/* Save current page in R1 and write the requested one, if they differ. */
-	mdio_prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
-	mdio_prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
-	mdio_prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  IMM(page)));
+	prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
+	prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
+	prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  IMM(page)));
 
 	for (reg = range->start; reg <= range->end; reg++) {
-		mdio_prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(reg),  REG(0)));
-		mdio_prog_push(prog, INSN(EMIT, REG(0), 0, 0));
+		prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(reg),  REG(0)));
+		prog_push(prog, INSN(EMIT, REG(0), 0, 0));
 	}
 
 	/* Restore old page if we changed it. */
-	mdio_prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
-	mdio_prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
+	prog_push(prog, INSN(JEQ,  REG(1), IMM(page),  IMM(1)));
+	prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(pdev->page_reg),  REG(1)));
 
 	return 0;
 }
@@ -15,7 +15,7 @@ int phy_read(struct mdio_device *dev, struct mdio_prog *prog, uint32_t reg)
 {
 	struct phy_device *pdev = (void *)dev;
 
-	mdio_prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(reg),  REG(0)));
+	prog_push(prog, INSN(READ,  IMM(pdev->id), IMM(reg),  REG(0)));
 	return 0;
 }
 
@@ -24,13 +24,14 @@ int phy_write(struct mdio_device *dev, struct mdio_prog *prog,
 {
 	struct phy_device *pdev = (void *)dev;
 
-	mdio_prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(reg),  val));
+	prog_push(prog, INSN(WRITE,  IMM(pdev->id), IMM(reg),  val));
 	return 0;
 }
 
 static const struct mdio_driver phy_driver = {
 	.read = phy_read,
 	.write = phy_write,
+	.nonfatal = true,
 };
 
 int phy_status_cb(uint32_t *data, int len, int err, void *_null)
@@ -228,9 +229,39 @@ int mmd_exec_with(const struct mdio_driver *drv,
 	return mdio_common_exec(&pdev.dev, argc, argv);
 }
 
+/* Native Clause 45 buses always perform a separate address cycle for
+ * each access, as the kernel's mii_bus interface does not expose
+ * post-increment reads. But at least the program can be kept
+ * constant in size by looping over the range, rather than unrolling
+ * it. */
+static int mmd_dump(struct mdio_device *dev, struct mdio_prog *prog,
+		    struct reg_range *range)
+{
+	struct phy_device *pdev = (void *)dev;
+	int loop;
+
+	prog_push(prog, INSN(ADD,  IMM(range->start), IMM(0), REG(1)));
+
+	loop = prog->len;
+	prog_push(prog, INSN(READ, IMM(pdev->id), REG(1),  REG(0)));
+	prog_push(prog, INSN(EMIT, REG(0), 0, 0));
+	prog_push(prog, INSN(ADD,  REG(1), IMM(1), REG(1)));
+	prog_push(prog, INSN(JNE,  REG(1), IMM(range->end + 1),
+			     GOTO(prog->len, loop)));
+	return 0;
+}
+
+static const struct mdio_driver mmd_driver = {
+	.read = phy_read,
+	.write = phy_write,
+
+	.dump = mmd_dump,
+	.nonfatal = true,
+};
+
 int mmd_exec(const char *bus, int argc, char **argv)
 {
-	return mmd_exec_with(&phy_driver, bus, argc, argv);
+	return mmd_exec_with(&mmd_driver, bus, argc, argv);
 }
 DEFINE_CMD("mmd", mmd_exec);
 
@@ -242,15 +273,22 @@ static int mmd_c22_read(struct mdio_device *dev, struct mdio_prog *prog,
 	uint8_t devad = pdev->id & MDIO_PHY_ID_DEVAD;
 	uint16_t ctrl = devad;
 
+	/* Let the kernel do the indirection if it can, which also lets
+	 * it skip the address phase when it is redundant. */
+	if (mdio_bus_supports(dev->bus, MDIO_NL_OP_MMD_READ)) {
+		prog_push(prog, INSN(MMD_READ, IMM(pdev->id), IMM(reg),  REG(0)));
+		return 0;
+	}
+
 	/* Set the address */
 	ctrl = devad;
-	mdio_prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
-	mdio_prog_push(prog, INSN(WRITE, IMM(prtad), IMM(14),  IMM(reg)));
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(14),  IMM(reg)));
 
 	/* Read out the data */
 	ctrl |= 1 << 14;
-	mdio_prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
-	mdio_prog_push(prog, INSN(READ,  IMM(prtad), IMM(14),  REG(0)));
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
+	prog_push(prog, INSN(READ,  IMM(prtad), IMM(14),  REG(0)));
 	return 0;
 }
 
@@ -262,21 +300,60 @@ static int mmd_c22_write(struct mdio_device *dev, struct mdio_prog *prog,
 	uint8_t devad = pdev->id & MDIO_PHY_ID_DEVAD;
 	uint16_t ctrl = devad;
 
+	if (mdio_bus_supports(dev->bus, MDIO_NL_OP_MMD_WRITE)) {
+		prog_push(prog, INSN(MMD_WRITE, IMM(pdev->id), IMM(reg),  val));
+		return 0;
+	}
+
 	/* Set the address */
 	ctrl = devad;
-	mdio_prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
-	mdio_prog_push(prog, INSN(WRITE, IMM(prtad), IMM(14),  IMM(reg)));
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(14),  IMM(reg)));
 
 	/* Write the data */
 	ctrl |= 1 << 14;
-	mdio_prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
-	mdio_prog_push(prog, INSN(WRITE, IMM(prtad), IMM(14),  val));
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(14),  val));
+	return 0;
+}
+
+/* One address phase per register, either done by the kernel, which
+ * then also keeps the program small, or spelled out here. The range
+ * is looped over in both cases, so that the program size does not
+ * depend on it. */
+static int mmd_c22_dump(struct mdio_device *dev, struct mdio_prog *prog,
+			struct reg_range *range)
+{
+	struct phy_device *pdev = (void *)dev;
+	uint8_t prtad = (pdev->id & MDIO_PHY_ID_PRTAD) >> 5;
+	uint8_t devad = pdev->id & MDIO_PHY_ID_DEVAD;
+	uint16_t ctrl = devad;
+	int loop;
+
+	prog_push(prog, INSN(ADD,  IMM(range->start), IMM(0), REG(1)));
+
+	loop = prog->len;
+	if (mdio_bus_supports(dev->bus, MDIO_NL_OP_MMD_READ)) {
+		prog_push(prog, INSN(MMD_READ, IMM(pdev->id), REG(1),  REG(0)));
+	} else {
+		prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
+		prog_push(prog, INSN(WRITE, IMM(prtad), IMM(14),  REG(1)));
+		prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl | 1 << 14)));
+		prog_push(prog, INSN(READ,  IMM(prtad), IMM(14),  REG(0)));
+	}
+	prog_push(prog, INSN(EMIT, REG(0), 0, 0));
+	prog_push(prog, INSN(ADD,  REG(1), IMM(1), REG(1)));
+	prog_push(prog, INSN(JNE,  REG(1), IMM(range->end + 1),
+			     GOTO(prog->len, loop)));
 	return 0;
 }
 
 static const struct mdio_driver mmd_c22_driver = {
 	.read = mmd_c22_read,
 	.write = mmd_c22_write,
+
+	.dump = mmd_c22_dump,
+	.nonfatal = true,
 };
 
 int mmd_c22_exec(const char *bus, int argc, char **argv)
@@ -284,3 +361,50 @@ int mmd_c22_exec(const char *bus, int argc, char **argv)
 	return mmd_exec_with(&mmd_c22_driver, bus, argc, argv);
 }
 DEFINE_CMD("mmd-c22", mmd_c22_exec);
+
+/* Use the "data, post increment on reads and writes" function of the
+ * MMD access control register, such that the whole range can be read
+ * out after a single address phase. Many PHYs do not implement it
+ * reliably, which is why this is not the default. */
+static int mmd_c22_inc_dump(struct mdio_device *dev, struct mdio_prog *prog,
+			    struct reg_range *range)
+{
+	struct phy_device *pdev = (void *)dev;
+	uint8_t prtad = (pdev->id & MDIO_PHY_ID_PRTAD) >> 5;
+	uint8_t devad = pdev->id & MDIO_PHY_ID_DEVAD;
+	uint16_t ctrl = devad;
+	int loop;
+
+	/* Set the start address */
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(14),  IMM(range->start)));
+
+	ctrl |= 2 << 14;
+	prog_push(prog, INSN(WRITE, IMM(prtad), IMM(13),  IMM(ctrl)));
+
+	/* Read out the data, R1 counts the number of registers read,
+	 * wrapping around to 0 if the whole MMD is dumped. */
+	prog_push(prog, INSN(ADD,  IMM(0), IMM(0), REG(1)));
+
+	loop = prog->len;
+	prog_push(prog, INSN(READ, IMM(prtad), IMM(14),  REG(0)));
+	prog_push(prog, INSN(EMIT, REG(0), 0, 0));
+	prog_push(prog, INSN(ADD,  REG(1), IMM(1), REG(1)));
+	prog_push(prog, INSN(JNE,  REG(1), IMM(range->end - range->start + 1),
+			     GOTO(prog->len, loop)));
+	return 0;
+}
+
+static const struct mdio_driver mmd_c22_inc_driver = {
+	.read = mmd_c22_read,
+	.write = mmd_c22_write,
+
+	.dump = mmd_c22_inc_dump,
+	.nonfatal = true,
+};
+
+int mmd_c22_inc_exec(const char *bus, int argc, char **argv)
+{
+	return mmd_exec_with(&mmd_c22_inc_driver, bus, argc, argv);
+}
+DEFINE_CMD("mmd-c22-inc", mmd_c22_inc_exec);
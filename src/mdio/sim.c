@@ -0,0 +1,922 @@
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/mdio.h>
+
+#include "mdio.h"
+#include "mdio-vm.h"
+
+/* In-process stand-in for mdio-netlink, selected by pointing
+ * MDIO_SIM at a description of the simulated buses. Programs are
+ * executed against a register model, using a simulated clock, so
+ * that instruction and frame counts, and timings, are deterministic.
+ *
+ * The description holds one directive per line:
+ *
+ *   bus NAME [c45] [clock HZ]    Start describing a new bus
+ *   phy ADDR [paged PREG]        PHY, optionally paged via PREG
+ *   mvls ADDR                    Multi-chip LinkStreet switch
+ *   fail ADDR                    Accesses to ADDR fail with EIO
+ *   reg ADDR [SPACE:]REG VAL     Initial value of a register, SPACE
+ *                                is a page, or a LinkStreet device
+ *   mmd ADDR DEVAD:REG VAL       Initial value of a Clause 45 register
+ *
+ * The model behaves like the one in mdio-sim.ko, and programs are run
+ * by the same VM as in mdio-netlink. */
+
+#define SIM_PROG_MAX    512
+#define SIM_TIMEOUT_MAX 10000
+
+/* Roughly what fits in one of mdio-netlink's replies */
+#define SIM_MSG_DATA_MAX 928
+#define SIM_CLOCK       2500000
+#define SIM_INSN_NS     100
+
+#define SIM_SMI_BUSY     BIT(15)
+#define SIM_SMI_C22      BIT(12)
+#define SIM_SMI_OP_MASK  (BIT(11) | BIT(10))
+#define SIM_SMI_OP_WRITE BIT(10)
+#define SIM_SMI_OP_READ  BIT(11)
+
+#define SIM_MMD_FUNC_MASK 0xc000
+
+enum sim_dev_type {
+	SIM_DEV_NONE,
+	SIM_DEV_PHY,
+	SIM_DEV_MVLS,
+};
+
+struct sim_dev {
+	enum sim_dev_type type;
+	bool fail;
+	bool paged;
+	uint16_t page_reg;
+
+	uint16_t mmd_ctrl;
+	uint16_t mmd_addr;
+};
+
+struct sim_reg {
+	uint32_t key;
+	uint16_t val;
+};
+
+struct sim_bus {
+	char id[64];
+	bool c45;
+	uint32_t clock;
+
+	struct sim_dev devs[MDIO_DEV_MAX];
+
+	/* Sorted on key */
+	struct sim_reg *regs;
+	size_t nregs;
+};
+
+static struct {
+	struct sim_bus *buses;
+	size_t nbuses;
+} sim;
+
+static bool sim_enabled;
+
+/* Same layout as the keys used by mdio-sim.ko */
+static uint32_t sim_key_c22(int addr, uint16_t page, int reg)
+{
+	return (uint32_t)addr << 13 | page << 5 | reg;
+}
+
+static uint32_t sim_key_c45(int addr, int devad, uint16_t reg)
+{
+	return 1U << 26 | (uint32_t)addr << 21 | devad << 16 | reg;
+}
+
+static uint32_t sim_key_mvls(int addr, int dev, int reg)
+{
+	return 2U << 26 | (uint32_t)addr << 10 | dev << 5 | reg;
+}
+
+static struct sim_reg *sim_find(struct sim_bus *bus, uint32_t key, size_t *pos)
+{
+	size_t lo = 0, hi = bus->nregs, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+
+		if (bus->regs[mid].key == key)
+			return &bus->regs[mid];
+
+		if (bus->regs[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (pos)
+		*pos = lo;
+
+	return NULL;
+}
+
+static uint16_t sim_get(struct sim_bus *bus, uint32_t key)
+{
+	struct sim_reg *reg = sim_find(bus, key, NULL);
+
+	return reg ? reg->val : 0;
+}
+
+static int sim_set(struct sim_bus *bus, uint32_t key, uint16_t val)
+{
+	struct sim_reg *reg, *regs;
+	size_t pos;
+
+	reg = sim_find(bus, key, &pos);
+	if (reg) {
+		reg->val = val;
+		return 0;
+	}
+
+	regs = realloc(bus->regs, (bus->nregs + 1) * sizeof(*regs));
+	if (!regs)
+		return -ENOMEM;
+
+	memmove(&regs[pos + 1], &regs[pos], (bus->nregs - pos) * sizeof(*regs));
+	regs[pos] = (struct sim_reg) { .key = key, .val = val };
+	bus->regs = regs;
+	bus->nregs++;
+	return 0;
+}
+
+/* State of a single transfer */
+struct sim_xfer {
+	struct mdio_vm vm;
+	struct sim_bus *bus;
+
+	/* Time spent on the bus, or delaying. Instructions are
+	 * accounted for by mdio_vm_now(). */
+	uint64_t now;
+	uint64_t frame_ns;
+
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t frames;
+
+	/* Cached MMD address, like mdio-netlink does */
+	uint16_t mmd_dev;
+	uint16_t mmd_reg;
+
+	uint32_t *data;
+	int len;
+};
+
+static void sim_frames(struct sim_xfer *x, int n)
+{
+	x->frames += n;
+	x->now += n * x->frame_ns;
+}
+
+static int sim_emit(struct sim_xfer *x, uint32_t datum)
+{
+	uint32_t *data;
+
+	data = realloc(x->data, (x->len + 1) * sizeof(*data));
+	if (!data)
+		return -ENOMEM;
+
+	x->data = data;
+	x->data[x->len++] = datum;
+	return 0;
+}
+
+/* Like mdio-netlink, deliver the data in message-sized chunks, only
+ * the last of which carries the error. */
+static int sim_deliver(struct sim_xfer *x, mdio_xfer_cb_t cb, void *arg,
+		       int err)
+{
+	uint32_t *data = x->data;
+	int len = x->len, ret;
+
+	for (; len > SIM_MSG_DATA_MAX; data += SIM_MSG_DATA_MAX,
+		     len -= SIM_MSG_DATA_MAX) {
+		ret = cb(data, SIM_MSG_DATA_MAX, 0, arg);
+		if (ret)
+			return ret;
+	}
+
+	return cb(data, len, err, arg);
+}
+
+static uint16_t sim_page(struct sim_bus *bus, int addr, int reg)
+{
+	struct sim_dev *dev = &bus->devs[addr];
+
+	if (!dev->paged || reg == dev->page_reg)
+		return 0;
+
+	return sim_get(bus, sim_key_c22(addr, 0, dev->page_reg)) & 0xff;
+}
+
+static int sim_mmd(struct sim_bus *bus, int addr, uint16_t *val, bool write)
+{
+	struct sim_dev *dev = &bus->devs[addr];
+	uint32_t key;
+	int err = 0;
+
+	if (!(dev->mmd_ctrl & SIM_MMD_FUNC_MASK)) {
+		if (write)
+			dev->mmd_addr = *val;
+		else
+			*val = dev->mmd_addr;
+
+		return 0;
+	}
+
+	key = sim_key_c45(addr, dev->mmd_ctrl & 0x1f,
+			  dev->mmd_addr);
+	if (write)
+		err = sim_set(bus, key, *val);
+	else
+		*val = sim_get(bus, key);
+
+	switch (dev->mmd_ctrl & SIM_MMD_FUNC_MASK) {
+	case 0x8000:
+		dev->mmd_addr++;
+		break;
+	case 0xc000:
+		if (write)
+			dev->mmd_addr++;
+		break;
+	}
+
+	return err;
+}
+
+static int sim_mvls_cmd(struct sim_bus *bus, int addr, uint16_t cmd)
+{
+	uint32_t key = sim_key_mvls(addr, (cmd >> 5) & 0x1f, cmd & 0x1f);
+	uint32_t data = sim_key_c22(addr, 0, 1);
+
+	if (!(cmd & SIM_SMI_BUSY) || !(cmd & SIM_SMI_C22))
+		return 0;
+
+	switch (cmd & SIM_SMI_OP_MASK) {
+	case SIM_SMI_OP_WRITE:
+		return sim_set(bus, key, sim_get(bus, data));
+	case SIM_SMI_OP_READ:
+		return sim_set(bus, data, sim_get(bus, key));
+	}
+
+	return 0;
+}
+
+static int sim_read_c22(struct sim_xfer *x, int addr, int reg)
+{
+	struct sim_bus *bus = x->bus;
+	struct sim_dev *dev = &bus->devs[addr];
+	uint16_t val;
+	int err;
+
+	x->reads++;
+	sim_frames(x, 1);
+
+	if (dev->fail)
+		return -EIO;
+
+	switch (dev->type) {
+	case SIM_DEV_NONE:
+		return 0xffff;
+	case SIM_DEV_MVLS:
+		if (reg > 1)
+			return 0xffff;
+
+		return sim_get(bus, sim_key_c22(addr, 0, reg));
+	case SIM_DEV_PHY:
+		break;
+	}
+
+	switch (reg) {
+	case MII_PHYSID1:
+	case MII_PHYSID2:
+		if (!sim_find(bus, sim_key_c22(addr, 0, reg), NULL))
+			return reg == MII_PHYSID1 ? 0x0141 : 0x0dd0;
+		break;
+	case 13:
+		return dev->mmd_ctrl;
+	case 14:
+		err = sim_mmd(bus, addr, &val, false);
+		return err ? : val;
+	}
+
+	return sim_get(bus, sim_key_c22(addr, sim_page(bus, addr, reg), reg));
+}
+
+static int sim_write_c22(struct sim_xfer *x, int addr, int reg, uint16_t val)
+{
+	struct sim_bus *bus = x->bus;
+	struct sim_dev *dev = &bus->devs[addr];
+	int err;
+
+	x->writes++;
+	sim_frames(x, 1);
+
+	if (dev->fail)
+		return -EIO;
+
+	switch (dev->type) {
+	case SIM_DEV_NONE:
+		return 0;
+	case SIM_DEV_MVLS:
+		if (reg > 1)
+			return 0;
+
+		if (reg)
+			return sim_set(bus, sim_key_c22(addr, 0, 1), val);
+
+		err = sim_mvls_cmd(bus, addr, val);
+		if (err)
+			return err;
+
+		return sim_set(bus, sim_key_c22(addr, 0, 0), val & ~SIM_SMI_BUSY);
+	case SIM_DEV_PHY:
+		break;
+	}
+
+	switch (reg) {
+	case 13:
+		dev->mmd_ctrl = val;
+		return 0;
+	case 14:
+		return sim_mmd(bus, addr, &val, true);
+	}
+
+	return sim_set(bus, sim_key_c22(addr, sim_page(bus, addr, reg), reg), val);
+}
+
+static int sim_mmd_addr(struct sim_xfer *x, uint16_t dev, uint16_t reg)
+{
+	int prtad = (dev & MDIO_PHY_ID_PRTAD) >> 5;
+	int devad = dev & MDIO_PHY_ID_DEVAD;
+	int err;
+
+	if (x->mmd_dev == dev && x->mmd_reg == reg)
+		return 0;
+
+	x->mmd_dev = 0;
+
+	err = sim_write_c22(x, prtad, 13, devad);
+	err = err ? : sim_write_c22(x, prtad, 14, reg);
+	err = err ? : sim_write_c22(x, prtad, 13, devad | 0x4000);
+	if (err)
+		return err;
+
+	x->mmd_dev = dev;
+	x->mmd_reg = reg;
+	return 0;
+}
+
+static int sim_mmd_read(struct sim_xfer *x, uint16_t dev, uint16_t reg)
+{
+	int err;
+
+	err = sim_mmd_addr(x, dev, reg);
+	if (err)
+		return err;
+
+	return sim_read_c22(x, (dev & MDIO_PHY_ID_PRTAD) >> 5, 14);
+}
+
+static int sim_mmd_write(struct sim_xfer *x, uint16_t dev, uint16_t reg,
+			 uint16_t val)
+{
+	int err;
+
+	err = sim_mmd_addr(x, dev, reg);
+	if (err)
+		return err;
+
+	return sim_write_c22(x, (dev & MDIO_PHY_ID_PRTAD) >> 5, 14, val);
+}
+
+static int sim_read(struct sim_xfer *x, uint16_t dev, uint16_t reg)
+{
+	int prtad = (dev & MDIO_PHY_ID_PRTAD) >> 5;
+	int devad = dev & MDIO_PHY_ID_DEVAD;
+
+	if (!(dev & MDIO_PHY_ID_C45))
+		return sim_read_c22(x, dev & 0x1f, reg & 0x1f);
+
+	if (!x->bus->c45)
+		return sim_mmd_read(x, dev, reg);
+
+	/* Address and data frames */
+	x->reads++;
+	sim_frames(x, 2);
+
+	if (x->bus->devs[prtad].fail)
+		return -EIO;
+
+	if (x->bus->devs[prtad].type != SIM_DEV_PHY)
+		return 0xffff;
+
+	return sim_get(x->bus, sim_key_c45(prtad, devad, reg));
+}
+
+static int sim_write(struct sim_xfer *x, uint16_t dev, uint16_t reg,
+		     uint16_t val)
+{
+	int prtad = (dev & MDIO_PHY_ID_PRTAD) >> 5;
+	int devad = dev & MDIO_PHY_ID_DEVAD;
+
+	if (!(dev & MDIO_PHY_ID_C45)) {
+		if (reg == 13 || reg == 14)
+			x->mmd_dev = 0;
+
+		return sim_write_c22(x, dev & 0x1f, reg & 0x1f, val);
+	}
+
+	if (!x->bus->c45)
+		return sim_mmd_write(x, dev, reg, val);
+
+	x->writes++;
+	sim_frames(x, 2);
+
+	if (x->bus->devs[prtad].fail)
+		return -EIO;
+
+	if (x->bus->devs[prtad].type != SIM_DEV_PHY)
+		return 0;
+
+	return sim_set(x->bus, sim_key_c45(prtad, devad, reg), val);
+}
+
+/* Hooks used by mdio_vm_eval() */
+
+static int mdio_vm_read(struct mdio_vm *vm, u16 dev, u16 reg)
+{
+	return sim_read(container_of(vm, struct sim_xfer, vm), dev, reg);
+}
+
+static int mdio_vm_write(struct mdio_vm *vm, u16 dev, u16 reg, u16 val)
+{
+	return sim_write(container_of(vm, struct sim_xfer, vm), dev, reg, val);
+}
+
+static int mdio_vm_mmd_read(struct mdio_vm *vm, u16 dev, u16 reg)
+{
+	return sim_mmd_read(container_of(vm, struct sim_xfer, vm), dev, reg);
+}
+
+static int mdio_vm_mmd_write(struct mdio_vm *vm, u16 dev, u16 reg, u16 val)
+{
+	return sim_mmd_write(container_of(vm, struct sim_xfer, vm),
+			     dev, reg, val);
+}
+
+static int mdio_vm_emit(struct mdio_vm *vm, u32 datum)
+{
+	return sim_emit(container_of(vm, struct sim_xfer, vm), datum);
+}
+
+static int mdio_vm_yield(struct mdio_vm *vm)
+{
+	return 0;
+}
+
+static void mdio_vm_lock(struct mdio_vm *vm)
+{
+}
+
+static void mdio_vm_unlock(struct mdio_vm *vm)
+{
+}
+
+static u64 mdio_vm_now(struct mdio_vm *vm)
+{
+	struct sim_xfer *x = container_of(vm, struct sim_xfer, vm);
+
+	return x->now + (u64)vm->insns * SIM_INSN_NS;
+}
+
+static void mdio_vm_delay(struct mdio_vm *vm, u16 us)
+{
+	container_of(vm, struct sim_xfer, vm)->now += us * 1000ULL;
+}
+
+static int sim_validate(const struct mdio_prog *prog)
+{
+	int i;
+
+	if (prog->len > SIM_PROG_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < prog->len; i++) {
+		if (mdio_vm_check_insn(&prog->insns[i]) != MDIO_VM_OK)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static struct sim_bus *sim_bus_find(const char *id)
+{
+	size_t i;
+
+	for (i = 0; i < sim.nbuses; i++) {
+		if (!strcmp(sim.buses[i].id, id))
+			return &sim.buses[i];
+	}
+
+	return NULL;
+}
+
+static int sim_xfer_init(struct sim_xfer *x, const char *id,
+			 uint32_t timeout_us)
+{
+	memset(x, 0, sizeof(*x));
+
+	x->bus = sim_bus_find(id);
+	if (!x->bus)
+		return -ENODEV;
+
+	/* 32 bits of preamble, and 32 bits of frame */
+	x->frame_ns = 64 * 1000000000ULL / x->bus->clock;
+	x->vm.timeout_us = timeout_us;
+	return 0;
+}
+
+int mdio_sim_xfer(const char *bus, struct mdio_prog *prog,
+		  mdio_xfer_cb_t cb, void *arg, uint32_t timeout_us)
+{
+	struct sim_xfer x;
+	int err, ret;
+
+	err = sim_xfer_init(&x, bus, timeout_us);
+	if (err)
+		return err;
+
+	err = sim_validate(prog);
+	if (err)
+		return err;
+
+	x.vm.prog = prog->insns;
+	x.vm.prog_len = prog->len;
+	x.vm.flags = prog->flags;
+
+	if (prog->state) {
+		x.vm.state = *prog->state;
+		if ((x.vm.state.pc && x.vm.state.pc >= x.vm.prog_len) ||
+		    !mdio_vm_state_valid(&x.vm))
+			return -EINVAL;
+	}
+
+	err = mdio_vm_eval(&x.vm);
+
+	if (prog->state) {
+		if (x.vm.stopped)
+			*prog->state = x.vm.state;
+		else
+			memset(prog->state, 0, sizeof(*prog->state));
+	}
+
+	if (prog->report) {
+		*prog->report = (struct mdio_nl_report) {
+			.insns = x.vm.insns,
+			.reads = x.reads,
+			.writes = x.writes,
+			.frames = x.frames,
+			.eval_ns = mdio_vm_now(&x.vm),
+		};
+	}
+
+	ret = sim_deliver(&x, cb, arg, err);
+	free(x.data);
+	return err ? : ret;
+}
+
+int mdio_sim_read_list(const char *bus, const struct mdio_nl_reg *regs, int n,
+		       uint32_t flags, mdio_xfer_cb_t cb, void *arg)
+{
+	struct sim_xfer x;
+	int i, ret, err;
+	uint32_t datum;
+
+	err = sim_xfer_init(&x, bus, 1000000);
+	if (err)
+		return err;
+
+	for (i = 0; i < n; i++) {
+		ret = sim_read(&x, regs[i].dev, regs[i].reg);
+		if (ret >= 0) {
+			datum = ret;
+		} else if (flags & MDIO_NL_F_NONFATAL) {
+			datum = mdio_vm_datum(0xffff, -ret);
+		} else {
+			err = ret;
+			break;
+		}
+
+		err = sim_emit(&x, datum);
+		if (err)
+			break;
+	}
+
+	ret = sim_deliver(&x, cb, arg, err);
+	free(x.data);
+	return err ? : ret;
+}
+
+int mdio_sim_write_list(const char *bus, const struct mdio_nl_write *writes,
+			int n, bool verify, mdio_xfer_cb_t cb, void *arg)
+{
+	const struct mdio_nl_write *w;
+	struct sim_xfer x;
+	int i, ret, err;
+	uint16_t val;
+
+	err = sim_xfer_init(&x, bus, 1000000);
+	if (err)
+		return err;
+
+	for (i = 0; !err && i < n; i++) {
+		w = &writes[i];
+		val = w->val;
+
+		if (w->mask) {
+			ret = sim_read(&x, w->dev, w->reg);
+			if (ret < 0) {
+				err = ret;
+				break;
+			}
+
+			val |= ret & w->mask;
+		}
+
+		err = sim_write(&x, w->dev, w->reg, val);
+		if (err || !verify)
+			continue;
+
+		ret = sim_read(&x, w->dev, w->reg);
+		if (ret < 0)
+			err = ret;
+		else if (ret != val)
+			err = sim_emit(&x, (i << 16) | ret);
+	}
+
+	ret = sim_deliver(&x, cb, arg, err);
+	free(x.data);
+	return err ? : ret;
+}
+
+int mdio_sim_bus_info(const char *bus, struct mdio_bus_info *info)
+{
+	struct sim_bus *sb = sim_bus_find(bus);
+
+	if (!sb)
+		return -ENODEV;
+
+	memset(info, 0, sizeof(*info));
+	snprintf(info->id, sizeof(info->id), "%s", sb->id);
+	info->caps = BIT(MDIO_NL_BUS_CAP_C22);
+	if (sb->c45)
+		info->caps |= BIT(MDIO_NL_BUS_CAP_C45);
+
+	info->clock = sb->clock;
+	info->isa = ((1U << (MDIO_NL_OP_MAX + 1)) - 1) & ~1U;
+	info->flags = MDIO_NL_F_NONFATAL | MDIO_NL_F_REPORT;
+	info->prog_max = SIM_PROG_MAX;
+	info->timeout_max = SIM_TIMEOUT_MAX;
+	return 0;
+}
+
+int mdio_sim_for_each(const char *match,
+		      int (*cb)(const char *bus, void *arg), void *arg)
+{
+	size_t i;
+	int err;
+
+	for (err = 0, i = 0; i < sim.nbuses; i++) {
+		if (fnmatch(match, sim.buses[i].id, 0))
+			continue;
+
+		err = cb(sim.buses[i].id, arg);
+		if (err)
+			break;
+	}
+
+	return err;
+}
+
+bool mdio_sim_enabled(void)
+{
+	return sim_enabled;
+}
+
+/* Description parsing */
+
+static int sim_parse_addr(const char *str)
+{
+	unsigned long addr;
+	char *end;
+
+	if (!str)
+		return -EINVAL;
+
+	addr = strtoul(str, &end, 0);
+	if (*end || addr >= MDIO_DEV_MAX)
+		return -EINVAL;
+
+	return addr;
+}
+
+static int sim_parse_u16(const char *str, uint16_t *val)
+{
+	unsigned long v;
+	char *end;
+
+	if (!str)
+		return -EINVAL;
+
+	v = strtoul(str, &end, 0);
+	if (*end || v > 0xffff)
+		return -EINVAL;
+
+	*val = v;
+	return 0;
+}
+
+/* [SPACE:]REG */
+static int sim_parse_reg(char *str, uint16_t *space, uint16_t *reg)
+{
+	char *sep;
+
+	if (!str)
+		return -EINVAL;
+
+	sep = strchr(str, ':');
+	if (!sep) {
+		*space = 0;
+		return sim_parse_u16(str, reg);
+	}
+
+	*sep = '\0';
+	return sim_parse_u16(str, space) ? : sim_parse_u16(sep + 1, reg);
+}
+
+static int sim_parse_bus(char **save)
+{
+	struct sim_bus *buses, *bus;
+	char *tok;
+
+	tok = strtok_r(NULL, " \t", save);
+	if (!tok || sim_bus_find(tok))
+		return -EINVAL;
+
+	buses = realloc(sim.buses, (sim.nbuses + 1) * sizeof(*buses));
+	if (!buses)
+		return -ENOMEM;
+
+	sim.buses = buses;
+	bus = &sim.buses[sim.nbuses++];
+	memset(bus, 0, sizeof(*bus));
+	snprintf(bus->id, sizeof(bus->id), "%s", tok);
+	bus->clock = SIM_CLOCK;
+
+	while ((tok = strtok_r(NULL, " \t", save))) {
+		if (!strcmp(tok, "c45")) {
+			bus->c45 = true;
+		} else if (!strcmp(tok, "clock")) {
+			tok = strtok_r(NULL, " \t", save);
+			if (!tok)
+				return -EINVAL;
+
+			bus->clock = strtoul(tok, NULL, 0);
+			if (!bus->clock)
+				return -EINVAL;
+		} else {
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int sim_parse_line(char *line)
+{
+	struct sim_bus *bus = sim.nbuses ? &sim.buses[sim.nbuses - 1] : NULL;
+	uint16_t space, reg, val;
+	struct sim_dev *dev;
+	char *save, *tok;
+	int addr;
+
+	tok = strtok_r(line, " \t", &save);
+	if (!tok || *tok == '#')
+		return 0;
+
+	if (!strcmp(tok, "bus"))
+		return sim_parse_bus(&save);
+
+	if (!bus)
+		return -EINVAL;
+
+	addr = sim_parse_addr(strtok_r(NULL, " \t", &save));
+	if (addr < 0)
+		return addr;
+
+	dev = &bus->devs[addr];
+
+	if (!strcmp(tok, "phy")) {
+		dev->type = SIM_DEV_PHY;
+
+		tok = strtok_r(NULL, " \t", &save);
+		if (!tok)
+			return 0;
+
+		if (strcmp(tok, "paged") ||
+		    sim_parse_u16(strtok_r(NULL, " \t", &save), &dev->page_reg) ||
+		    dev->page_reg >= 32 || dev->page_reg == 13 ||
+		    dev->page_reg == 14)
+			return -EINVAL;
+
+		dev->paged = true;
+		return 0;
+	} else if (!strcmp(tok, "mvls")) {
+		dev->type = SIM_DEV_MVLS;
+		return 0;
+	} else if (!strcmp(tok, "fail")) {
+		dev->fail = true;
+		return 0;
+	} else if (!strcmp(tok, "reg")) {
+		if (sim_parse_reg(strtok_r(NULL, " \t", &save), &space, &reg) ||
+		    sim_parse_u16(strtok_r(NULL, " \t", &save), &val) ||
+		    reg >= 32 || space > 0xff)
+			return -EINVAL;
+
+		if (dev->type == SIM_DEV_MVLS)
+			return sim_set(bus, sim_key_mvls(addr, space & 0x1f, reg),
+				       val);
+
+		return sim_set(bus, sim_key_c22(addr, space, reg), val);
+	} else if (!strcmp(tok, "mmd")) {
+		if (sim_parse_reg(strtok_r(NULL, " \t", &save), &space, &reg) ||
+		    sim_parse_u16(strtok_r(NULL, " \t", &save), &val) ||
+		    space >= 32)
+			return -EINVAL;
+
+		return sim_set(bus, sim_key_c45(addr, space, reg), val);
+	}
+
+	return -EINVAL;
+}
+
+int mdio_sim_load(FILE *fp, const char *name)
+{
+	char line[0x100];
+	int err = 0, n;
+
+	for (n = 1; fgets(line, sizeof(line), fp); n++) {
+		line[strcspn(line, "\r\n")] = '\0';
+
+		err = sim_parse_line(line);
+		if (err) {
+			fprintf(stderr, "ERROR: %s:%d: Invalid description\n",
+				name, n);
+			break;
+		}
+	}
+
+	if (!err)
+		sim_enabled = true;
+
+	return err;
+}
+
+int mdio_sim_init(const char *path)
+{
+	FILE *fp;
+	int err;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		err = -errno;
+		fprintf(stderr, "ERROR: Unable to open \"%s\"\n", path);
+		return err;
+	}
+
+	err = mdio_sim_load(fp, path);
+	fclose(fp);
+	return err;
+}
+
+void mdio_sim_exit(void)
+{
+	size_t i;
+
+	for (i = 0; i < sim.nbuses; i++)
+		free(sim.buses[i].regs);
+
+	free(sim.buses);
+	memset(&sim, 0, sizeof(sim));
+	sim_enabled = false;
+}
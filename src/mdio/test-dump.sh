@@ -0,0 +1,64 @@
+#!/bin/sh
+# Dump ranges that do not fit in a single reply from the kernel, using
+# mdio's in-process simulation backend, and verify that every register
+# is reported exactly once and in order.
+
+mdio=${MDIO:-./mdio}
+desc=$(mktemp) || exit 1
+out=$(mktemp) || exit 1
+trap 'rm -f "$desc" "$out"' EXIT
+
+cat >"$desc" <<DESC
+bus sim-0 c45
+phy 1
+mmd 1 4:0x000 0x1111
+mmd 1 4:0x5ff 0x2222
+mmd 1 4:0xfff 0x3333
+fail 7
+DESC
+
+export MDIO_SIM="$desc"
+fail=0
+
+# check NAME COUNT FIRST LAST CMD...
+check()
+{
+	name=$1 count=$2 first=$3 last=$4
+	shift 4
+
+	"$mdio" "$@" >"$out"
+	rc=$?
+
+	if [ $rc -ne 0 ]; then
+		echo "FAIL: $name: exited with $rc"
+		fail=1
+	elif [ "$(wc -l <"$out")" -ne "$count" ]; then
+		echo "FAIL: $name: expected $count registers, got $(wc -l <"$out")"
+		fail=1
+	elif [ "$(head -n 1 "$out")" != "$first" ] ||
+	     [ "$(tail -n 1 "$out")" != "$last" ]; then
+		echo "FAIL: $name: unexpected output"
+		fail=1
+	elif ! grep -q '^0x05ff: 0x2222$' "$out"; then
+		echo "FAIL: $name: register 0x5ff missing"
+		fail=1
+	else
+		echo "PASS: $name"
+	fi
+}
+
+check "mmd dump" 4096 "0x0000: 0x1111" "0x0fff: 0x3333" \
+      sim-0 mmd 1:4 dump 0-0xfff
+check "mmd-c22 dump" 4096 "0x0000: 0x1111" "0x0fff: 0x3333" \
+      sim-0 mmd-c22 1:4 dump 0-0xfff
+
+# A range of unreadable registers is reported in full, with an error
+"$mdio" sim-0 mmd 7:4 dump 0-0x7ff 2>/dev/null >"$out"
+if [ $? -ne 1 ] || [ "$(grep -c ': error (' "$out")" -ne 2048 ]; then
+	echo "FAIL: failing mmd dump"
+	fail=1
+else
+	echo "PASS: failing mmd dump"
+fi
+
+exit $fail
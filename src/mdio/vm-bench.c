@@ -0,0 +1,260 @@
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mdio.h"
+#include "mdio-vm.h"
+
+/* Micro-benchmark of the mdio-netlink VM. Programs are run in
+ * userspace, against a bus that responds immediately, so that the
+ * time measured is that of the interpreter itself. Run it before and
+ * after a change to mdio-vm.h to see its effect on dispatch. */
+
+struct bench_bus {
+	struct mdio_vm vm;
+
+	uint16_t c22[MDIO_DEV_MAX][32];
+	uint32_t emitted;
+};
+
+static int mdio_vm_read(struct mdio_vm *vm, u16 dev, u16 reg)
+{
+	struct bench_bus *bus = container_of(vm, struct bench_bus, vm);
+
+	if (mdio_phy_id_is_c45(dev))
+		return 0;
+
+	return bus->c22[dev & 0x1f][reg & 0x1f];
+}
+
+static int mdio_vm_write(struct mdio_vm *vm, u16 dev, u16 reg, u16 val)
+{
+	struct bench_bus *bus = container_of(vm, struct bench_bus, vm);
+
+	if (!mdio_phy_id_is_c45(dev))
+		bus->c22[dev & 0x1f][reg & 0x1f] = val;
+
+	return 0;
+}
+
+static int mdio_vm_mmd_read(struct mdio_vm *vm, u16 dev, u16 reg)
+{
+	return 0;
+}
+
+static int mdio_vm_mmd_write(struct mdio_vm *vm, u16 dev, u16 reg, u16 val)
+{
+	return 0;
+}
+
+static int mdio_vm_emit(struct mdio_vm *vm, u32 datum)
+{
+	container_of(vm, struct bench_bus, vm)->emitted++;
+	return 0;
+}
+
+static int mdio_vm_yield(struct mdio_vm *vm)
+{
+	return 0;
+}
+
+static void mdio_vm_lock(struct mdio_vm *vm)
+{
+}
+
+static void mdio_vm_unlock(struct mdio_vm *vm)
+{
+}
+
+static u64 mdio_vm_now(struct mdio_vm *vm)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void mdio_vm_delay(struct mdio_vm *vm, u16 us)
+{
+}
+
+/* Each program runs a loop, counting r0 from 0 until it wraps
+ * around, i.e. 64k times. */
+
+static struct mdio_nl_insn bench_alu[] = {
+	INSN(ADD, REG(0), IMM(1), REG(0)),
+	INSN(JNE, REG(0), IMM(0), GOTO(1, 0)),
+};
+
+static struct mdio_nl_insn bench_read[] = {
+	INSN(READ, IMM(1), IMM(2), REG(1)),
+	INSN(ADD, REG(0), IMM(1), REG(0)),
+	INSN(JNE, REG(0), IMM(0), GOTO(2, 0)),
+};
+
+static struct mdio_nl_insn bench_emit[] = {
+	INSN(READ, IMM(1), IMM(2), REG(1)),
+	INSN(EMIT, REG(1), 0, 0),
+	INSN(ADD, REG(0), IMM(1), REG(0)),
+	INSN(JNE, REG(0), IMM(0), GOTO(3, 0)),
+};
+
+static struct mdio_nl_insn bench_rmw[] = {
+	INSN(READ, IMM(1), IMM(4), REG(1)),
+	INSN(AND, REG(1), IMM(0xfff0), REG(1)),
+	INSN(OR, REG(1), IMM(0x0005), REG(1)),
+	INSN(WRITE, IMM(1), IMM(4), REG(1)),
+	INSN(ADD, REG(0), IMM(1), REG(0)),
+	INSN(JNE, REG(0), IMM(0), GOTO(5, 0)),
+};
+
+static struct mdio_nl_insn bench_page[] = {
+	INSN(PAGE, IMM(1), IMM(22), REG(0)),
+	INSN(READ, IMM(1), IMM(2), REG(1)),
+	INSN(ADD, REG(0), IMM(1), REG(0)),
+	INSN(JNE, REG(0), IMM(0), GOTO(3, 0)),
+};
+
+static struct mdio_nl_insn bench_mmd[] = {
+	INSN(MMD_READ, IMM(MDIO_PHY_ID_C45 | (1 << 5) | 4), IMM(0x1000),
+	     REG(1)),
+	INSN(ADD, REG(0), IMM(1), REG(0)),
+	INSN(JNE, REG(0), IMM(0), GOTO(2, 0)),
+};
+
+static struct mdio_nl_insn bench_section[] = {
+	INSN(LOCK, 0, 0, 0),
+	INSN(READ, IMM(1), IMM(2), REG(1)),
+	INSN(UNLOCK, 0, 0, 0),
+	INSN(ADD, REG(0), IMM(1), REG(0)),
+	INSN(JNE, REG(0), IMM(0), GOTO(4, 0)),
+};
+
+struct bench {
+	const char *name;
+	struct mdio_nl_insn *insns;
+	int len;
+};
+
+#define BENCH(_name) { #_name, bench_ ## _name, ARRAY_SIZE(bench_ ## _name) }
+
+static const struct bench benches[] = {
+	BENCH(alu),
+	BENCH(read),
+	BENCH(emit),
+	BENCH(rmw),
+	BENCH(page),
+	BENCH(mmd),
+	BENCH(section),
+};
+
+static int bench_validate(const struct bench *b)
+{
+	int i;
+
+	for (i = 0; i < b->len; i++) {
+		if (mdio_vm_check_insn(&b->insns[i]) != MDIO_VM_OK)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int bench_run(const struct bench *b, int runs)
+{
+	struct bench_bus bus;
+	uint64_t start, ns = 0, insns = 0;
+	int err, i;
+
+	err = bench_validate(b);
+	if (err) {
+		fprintf(stderr, "ERROR: %s: Invalid program\n", b->name);
+		return err;
+	}
+
+	for (i = 0; i < runs; i++) {
+		memset(&bus, 0, sizeof(bus));
+		bus.vm.prog = b->insns;
+		bus.vm.prog_len = b->len;
+		bus.vm.timeout_us = UINT32_MAX;
+
+		start = mdio_vm_now(&bus.vm);
+		err = mdio_vm_eval(&bus.vm);
+		ns += mdio_vm_now(&bus.vm) - start;
+
+		if (err) {
+			fprintf(stderr, "ERROR: %s: Failed (%d)\n", b->name, err);
+			return err;
+		}
+
+		insns += bus.vm.insns;
+	}
+
+	printf("%-8s  %10" PRIu64 "  %8.2f\n", b->name, insns,
+	       (double)ns / insns);
+	return 0;
+}
+
+static int usage(int rc, FILE *fp)
+{
+	size_t i;
+
+	fputs("Usage: mdio-vm-bench [-h] [-n RUNS] [PROGRAM ...]\n"
+	      "\n"
+	      "Run each PROGRAM (default: all) RUNS (default: 100) times through\n"
+	      "the mdio-netlink VM, against a bus without any latency, and report\n"
+	      "the average time spent per instruction.\n"
+	      "\n"
+	      "Programs:\n", fp);
+
+	for (i = 0; i < ARRAY_SIZE(benches); i++)
+		fprintf(fp, "  %s\n", benches[i].name);
+
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, runs = 100, err = 0;
+	size_t i;
+
+	while ((opt = getopt(argc, argv, "hn:")) != -1) {
+		switch (opt) {
+		case 'h':
+			return usage(0, stdout);
+		case 'n':
+			runs = strtol(optarg, NULL, 0);
+			if (runs <= 0)
+				return usage(1, stderr);
+			break;
+		default:
+			return usage(1, stderr);
+		}
+	}
+
+	argv += optind;
+	argc -= optind;
+
+	printf("%-8s  %10s  %8s\n", "PROGRAM", "INSNS", "NS/INSN");
+
+	for (i = 0; !err && i < ARRAY_SIZE(benches); i++) {
+		if (argc) {
+			int j;
+
+			for (j = 0; j < argc; j++)
+				if (!strcmp(argv[j], benches[i].name))
+					break;
+
+			if (j == argc)
+				continue;
+		}
+
+		err = bench_run(&benches[i], runs);
+	}
+
+	return err ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mdio.h"
+
+/* libFuzzer harness for the mdio-netlink VM. Each input is taken as a
+ * transfer request, which is validated and run by mdio-vm.h against
+ * the simulator's register model, just as the module would run it
+ * against a real bus. Programs that time out are resumed from the
+ * state they return, so that path is exercised as well.
+ *
+ * Inputs are laid out as a struct fuzz_hdr, followed by the program.
+ */
+
+struct fuzz_hdr {
+	uint32_t flags;		/* MDIO_NL_F_*, FUZZ_F_* */
+	uint32_t timeout_us;
+	struct mdio_nl_state state;
+};
+
+/* Run against the Clause 22 bus, rather than the Clause 45 one */
+#define FUZZ_F_C22   (1U << 31)
+/* Start out from the state in the header, rather than from scratch */
+#define FUZZ_F_STATE (1U << 30)
+
+/* Simulated time passes at 100 ns per instruction, this bounds the
+ * length of each run to a few thousand instructions. */
+#define FUZZ_TIMEOUT_MAX 500
+#define FUZZ_RESUMES     4
+
+static const char fuzz_desc[] =
+	"bus fuzz-c45 c45\n"
+	"phy 1 paged 22\n"
+	"reg 1 1 0x796d\n"
+	"reg 1 2:1 0x1234\n"
+	"mmd 1 4:0x1000 0x2040\n"
+	"mvls 4\n"
+	"fail 7\n"
+	"bus fuzz-c22 clock 12500000\n"
+	"phy 0\n"
+	"phy 2 paged 31\n"
+	"mvls 16\n"
+	"fail 3\n";
+
+static int fuzz_cb(uint32_t *data, int len, int err, void *arg)
+{
+	return 0;
+}
+
+static int fuzz_load(void)
+{
+	FILE *fp;
+	int err;
+
+	fp = fmemopen((void *)fuzz_desc, sizeof(fuzz_desc) - 1, "r");
+	if (!fp)
+		return -errno;
+
+	err = mdio_sim_load(fp, "fuzz");
+	fclose(fp);
+	return err;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct mdio_prog prog = MDIO_PROG_EMPTY;
+	struct mdio_nl_state state;
+	struct fuzz_hdr hdr;
+	const char *bus;
+	int i, err;
+
+	if (size < sizeof(hdr))
+		return -1;
+
+	memcpy(&hdr, data, sizeof(hdr));
+	data += sizeof(hdr);
+	size -= sizeof(hdr);
+
+	/* Each input starts out from the same register contents */
+	if (fuzz_load())
+		abort();
+
+	prog.len = size / sizeof(*prog.insns);
+	prog.insns = malloc(prog.len * sizeof(*prog.insns) ? : 1);
+	if (!prog.insns)
+		abort();
+
+	memcpy(prog.insns, data, prog.len * sizeof(*prog.insns));
+	prog.flags = hdr.flags & MDIO_NL_F_MASK;
+
+	if (hdr.flags & FUZZ_F_STATE)
+		state = hdr.state;
+	else
+		memset(&state, 0, sizeof(state));
+
+	prog.state = &state;
+
+	bus = (hdr.flags & FUZZ_F_C22) ? "fuzz-c22" : "fuzz-c45";
+
+	for (i = 0; i <= FUZZ_RESUMES; i++) {
+		err = mdio_sim_xfer(bus, &prog, fuzz_cb, NULL,
+				    hdr.timeout_us % FUZZ_TIMEOUT_MAX + 1);
+		if (err != -ETIMEDOUT)
+			break;
+	}
+
+	free(prog.insns);
+	mdio_sim_exit();
+	return 0;
+}
@@ -19,9 +19,9 @@ int xrs_read(struct mdio_device *dev, struct mdio_prog *prog, uint32_t reg)
 	struct xrs_device *xdev = (void *)dev;
 	uint16_t iba[2] = { reg & 0xfffe, reg >> 16 };
 
-	mdio_prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBA1), IMM(iba[1])));
-	mdio_prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBA0), IMM(iba[0])));
-	mdio_prog_push(prog, INSN(READ,  IMM(xdev->id), IMM(XRS_IBD),  REG(0)));
+	prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBA1), IMM(iba[1])));
+	prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBA0), IMM(iba[0])));
+	prog_push(prog, INSN(READ,  IMM(xdev->id), IMM(XRS_IBD),  REG(0)));
 	return 0;
 }
 
@@ -31,9 +31,9 @@ int xrs_write(struct mdio_device *dev, struct mdio_prog *prog,
 	struct xrs_device *xdev = (void *)dev;
 	uint16_t iba[2] = { (reg & 0xfffe) | 1, reg >> 16 };
 
-	mdio_prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBD),  IMM(val)));
-	mdio_prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBA1), IMM(iba[1])));
-	mdio_prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBA0), IMM(iba[0])));
+	prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBD),  val));
+	prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBA1), IMM(iba[1])));
+	prog_push(prog, INSN(WRITE, IMM(xdev->id), IMM(XRS_IBA0), IMM(iba[0])));
 	return 0;
 }
 